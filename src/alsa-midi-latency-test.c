@@ -32,14 +32,31 @@
 #include <errno.h>
 #include <alsa/asoundlib.h>
 
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/utsname.h>
 
+#include "compare.h"
+#include "forensics.h"
+#include "heatmap.h"
+#include "histogram.h"
+#include "monitor.h"
+#include "trace.h"
+#include "midi-parser.h"
+#include "ump.h"
+
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof *(a))
 #define ENABLE_UART
 
+/* UMP endpoints and sequencer clients came with alsa-lib 1.2.10 */
+#ifdef HAVE_SND_UMP_OPEN
+#define ENABLE_UMP
+#endif
+
 static snd_seq_t *seq;
-static snd_rawmidi_t *raw_in;
-static snd_rawmidi_t *raw_out;
 #ifdef ENABLE_UART
 #include <fcntl.h>
 #include <string.h>
@@ -50,6 +67,108 @@ static snd_rawmidi_t *raw_out;
 
 static volatile sig_atomic_t signal_received = 0;
 
+#if defined(CLOCK_MONOTONIC_RAW)
+#define HR_CLOCK CLOCK_MONOTONIC_RAW
+#else
+#define HR_CLOCK CLOCK_MONOTONIC
+#endif
+
+/* SysEx probes are sent in parts of SEND_CHUNK, see send_probe() */
+#define SEND_CHUNK 256
+#define SEND_WINDOW 1024
+
+/* samples per block; background traffic is on in every other block */
+#define TRAFFIC_BLOCK 100
+
+/* outliers kept by --forensics, and how old its baseline may get */
+#define FORENSICS_RECORDS 10
+#define FORENSICS_REFRESH_MS 100
+
+/* significance level of --compare */
+#define COMPARE_ALPHA 0.01
+
+/* --ci-width checks after this many samples, or every tenth of them */
+#define CI_CHECK_MIN 100
+#define CI_MAX_PERCENTILES 8
+
+/* batch size of the MSER warm-up detection, see -s auto */
+#define MSER_BATCH 5
+/* samples before -s auto first guesses the warm-up, and between guesses */
+#define MSER_CHECK_MIN 100
+
+/* --daemon: probes in the recent window, and how often the textfile is written */
+#define DAEMON_WINDOW 600
+#define DAEMON_PUBLISH_MS 1000
+
+/*
+ * --phase-sweep: the link is left idle for at least PHASE_IDLE_NS before
+ * each probe, and the wait for its send time ends spinning
+ */
+#define PHASE_IDLE_NS 2000000ULL
+#define PHASE_SPIN_NS 200000ULL
+
+/* --sched-compare switches the policy every SCHED_BLOCK probes */
+#define SCHED_BLOCK 100
+
+enum {
+	LINK_SEQ,
+	LINK_RAWMIDI,
+	LINK_UART,
+	LINK_UMP,
+};
+
+/* an output/input port pair, and what is needed to talk over it */
+struct link {
+	int type;
+	const char *output_name;
+	const char *input_name;
+	/* sequencer */
+	int port;
+	snd_seq_addr_t output_addr;
+	snd_seq_addr_t input_addr;
+	snd_midi_event_t *encoder;
+	snd_midi_event_t *decoder;
+	/* rawmidi */
+	snd_rawmidi_t *raw_in;
+	snd_rawmidi_t *raw_out;
+	/* UART */
+	int uart_fd_in;
+	int uart_fd_out;
+#ifdef ENABLE_UMP
+	/* UMP endpoint */
+	snd_ump_t *ump_in;
+	snd_ump_t *ump_out;
+#endif // ENABLE_UMP
+	/* probes go out as packets of ump_bits over UMP endpoints and clients */
+	int ump_bits;
+	int ump_jr;
+	struct ump_parser ump_parser;
+
+	/* held while writing a message, so messages never interleave */
+	pthread_mutex_t write_lock;
+
+	struct pollfd *pollfds;
+	int pollfds_count;
+	struct midi_parser parser;
+	unsigned char *sysex_buf;
+	unsigned char rec_buf[4096];
+
+	/* --trace-marker and --trace-json; unused unless set */
+	int marker_fd;
+	struct probe_times *times;
+	unsigned int probe_nr;
+};
+
+/* a probe message, prepared for the link it is sent over */
+struct probe {
+	const unsigned char *msg;
+	size_t len;
+	snd_seq_event_t ev;
+	/* on UMP links, msg points here; the packet starts at ump_first */
+	unsigned int ump[5];
+	int ump_first;
+};
+
 void print_uname()
 {
   struct utsname u;
@@ -84,17 +203,81 @@ static void check_snd(const char *operation, int err)
 		fatal("cannot %s - %s", operation, snd_strerror(err));
 }
 
-/* sets the process to "policy" policy at given priority */
-static int set_realtime_priority(int policy, int prio)
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+
+/* the kernel's struct sched_attr, which older C libraries lack */
+struct dl_sched_attr {
+	uint32_t size;
+	uint32_t sched_policy;
+	uint64_t sched_flags;
+	int32_t sched_nice;
+	uint32_t sched_priority;
+	uint64_t sched_runtime;
+	uint64_t sched_deadline;
+	uint64_t sched_period;
+};
+
+struct sched_setting {
+	int policy;
+	int prio;			/* SCHED_FIFO, SCHED_RR */
+	int nice;			/* SCHED_OTHER */
+	unsigned long long runtime_ns;	/* SCHED_DEADLINE, whose deadline */
+	unsigned long long period_ns;	/* is the end of the period */
+};
+
+static const char *policy_name(int policy)
+{
+	switch (policy) {
+	case SCHED_FIFO:
+		return "SCHED_FIFO";
+	case SCHED_RR:
+		return "SCHED_RR";
+	case SCHED_DEADLINE:
+		return "SCHED_DEADLINE";
+	default:
+		return "SCHED_OTHER";
+	}
+}
+
+/* sets the process to the given policy and its parameters */
+static int set_realtime_priority(const struct sched_setting *ss)
 {
 	struct sched_param schp;
 	memset(&schp, 0, sizeof(schp));
 
-	schp.sched_priority = prio;
-	if (sched_setscheduler(0, policy, &schp) != 0) {
+	if (ss->policy == SCHED_DEADLINE) {
+#ifdef SYS_sched_setattr
+		struct dl_sched_attr attr;
+
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.sched_policy = SCHED_DEADLINE;
+		attr.sched_runtime = ss->runtime_ns;
+		attr.sched_deadline = ss->period_ns;
+		attr.sched_period = ss->period_ns;
+		if (syscall(SYS_sched_setattr, 0, &attr, 0) != 0) {
+			perror("sched_setattr");
+			return -1;
+		}
+		return 0;
+#else
+		fputs("sched_setattr: not supported\n", stderr);
+		return -1;
+#endif
+	}
+
+	if (ss->policy != SCHED_OTHER)
+		schp.sched_priority = ss->prio;
+	if (sched_setscheduler(0, ss->policy, &schp) != 0) {
 		perror("sched_setscheduler");
 		return -1;
 	}
+	if (ss->policy == SCHED_OTHER && setpriority(PRIO_PROCESS, 0, ss->nice) != 0) {
+		perror("setpriority");
+		return -1;
+	}
 	return 0;
 }
 
@@ -361,9 +544,17 @@ static void usage(const char *argv0)
 	       "                              <random>, <min_latency_ms>, <mean_latency_ms>, <max_latency_ms>'\n"
 	       "  -R, --realtime             use realtime scheduling (default: no)\n"
 	       "  -P, --priority=int         scheduling priority, use with -R\n"
-	       "                             (default: maximum)\n\n"
+	       "                             (default: maximum)\n"
+	       "  --policy=name              scheduling policy for -R: fifo (default), rr,\n"
+	       "                             other, or deadline with a period of -w ms\n"
+	       "  --nice=int                 nice value for --policy=other (default: 0)\n"
+	       "  --dl-runtime=us            runtime per period for --policy=deadline\n"
+	       "                             (default: a quarter of the period)\n"
+	       "  --sched-compare=hz         probe at this rate under each policy in turn,\n"
+	       "                             -S times each, and compare the distributions\n\n"
 	       "  -S, --samples=# of samples to take for the measurement (default: 10000)\n"
-	       "  -s, --skip=# of samples    to skip at the beginning (default: 0)\n"
+	       "  -s, --skip=# of samples    to skip at the beginning (default: 0), or 'auto'\n"
+	       "                             to detect the warm-up with MSER-5 after the run\n"
 	       "  -w, --wait=ms              time interval between measurements\n"
 	       "  -r, --random-wait          use random interval between wait and 2*wait\n"
            "  -x                         disable debug output of measurements,\n"
@@ -371,9 +562,59 @@ static void usage(const char *argv0)
            "                             use this with -w to avoid CPU saturation.\n"
            " group bins in histogram:\n"
            "  -1 -2 -3 -4 -5 -6          0.1ms, 0.01ms, 0.001ms.. 0.000001ms (default: 0.1ms)\n\n"
+	       "  --sysex-sweep=min:max      send SysEx probes of doubling size from min to max bytes\n"
+	       "                             (-S samples each) and fit a fixed + per-byte cost model\n"
+	       "  --phase-sweep=us[:steps]   send at steps phases within a period of us microseconds,\n"
+	       "                             e.g. a USB frame (1000 or 125), -S samples each, and\n"
+	       "                             report latency by phase (default steps: 16)\n"
+	       "  --burst=channels[:notes]   send -S bursts of note ons, a chord of notes on each of\n"
+	       "                             channels, and report their skew and ordering\n"
+	       "  --single-write             write each burst at once instead of back-to-back\n\n"
+	       " background traffic on the output, on in every other block of %d samples:\n"
+	       "  --clock=bpm                MIDI clock (0xF8) at 24 ppqn\n"
+	       "  --active-sensing           active sensing (0xFE) every 300 ms\n"
+	       "  --cc-stream=rate           controller messages per second\n"
+	       "  --sysex-traffic=bytes:ms   a SysEx message of the given size every ms milliseconds\n\n"
+	       "  --forensics[=ms]           capture interrupt, scheduler and rusage deltas when a\n"
+	       "                             sample sets a new worst case or takes longer than ms\n"
+	       "  --trace-marker             write ftrace markers when each probe is sent and received\n"
+	       "  --trace-json=file          write the send, in flight and receive phase of each sample\n"
+	       "                             as Chrome trace events, for ui.perfetto.dev\n\n"
+	       "  --max-latency=ms           fail if the worst latency is higher (default: 6)\n"
+	       "  --save=file                save the samples, to compare later runs with\n"
+	       "  --summary=file             save a histogram of the samples that can be merged\n"
+	       "  --merge file...            merge such summaries of any number of runs, and\n"
+	       "                             print their percentiles; --summary saves the result\n"
+	       "  --heatmap                  show latency over time as a heatmap, with losses\n"
+	       "  --heatmap-svg=file         save that heatmap as an SVG image\n"
+	       "  --probe-types[=t,...]      alternate the probe among message types, and report\n"
+	       "                             each: clock, start, program, cc, bend, noteon\n"
+	       "                             (default: all); -S samples of each\n"
+	       "  --compare=file             test the samples against a saved baseline, and fail if\n"
+	       "  --max-regression=percent   a percentile got significantly worse (default: 10)\n\n"
+	       "  --ci-width=percent         stop sampling once the 95%% confidence intervals of the\n"
+	       "                             percentiles are this narrow; -S is the upper limit\n"
+	       "  --ci-percentiles=p,...     the percentiles for --ci-width (default: 50,99)\n"
+	       "  --max-time=s               stop sampling after s seconds\n\n"
+	       "  --daemon=hz                probe at this rate until interrupted, and publish\n"
+	       "                             Prometheus metrics:\n"
+	       "  --textfile=file              rewritten every second, for node_exporter\n"
+	       "  --socket=path                served on a Unix domain socket\n\n"
+	       "  --duplex=hz                send -S probes at this rate from one thread while\n"
+	       "                             another receives, to load both directions at once\n"
+	       "  --output2=port             with --duplex, the output and input of a second\n"
+	       "  --input2=port                loopback cable, probed at the same time\n\n"
+	       "  --ump=bits                 send the probes as 32, 64 or 128 bit MIDI 2.0 UMP\n"
+	       "                             packets; with -a, -o and -i are UMP endpoints\n"
+	       "                             (hw:x,y), and --output2/--input2 the MIDI 1.0\n"
+	       "                             ports of the same device to compare against\n"
+	       "  --ump-jr                   precede each probe with a JR Timestamp (-a only)\n\n"
+	       " sequencer routing cost, measured in-process without -o/-i:\n"
+	       "  --seq-chain=hops           through chains of up to hops forwarding clients\n"
+	       "  --seq-fanout=subs          to up to subs subscribers of the sending port\n\n"
 	       "  -h, --help                 this help\n"
 	       "  -V, --version              print current version\n"
-	       "\n", argv0);
+	       "\n", argv0, TRAFFIC_BLOCK);
 }
 
 static void print_version(void)
@@ -415,7 +656,6 @@ static void sighandler(int sig)
 	signal_received = 1;
 }
 
-#ifdef ENABLE_UART
 /* error handling for POSIX functions */
 static void check_posix(const char *operation, int err)
 {
@@ -423,6 +663,8 @@ static void check_posix(const char *operation, int err)
 		fatal("cannot %s - %s", operation, strerror(err));
 }
 
+#ifdef ENABLE_UART
+
 static unsigned int speedToBaudRate(unsigned int speed) {
 	switch(speed) {
 		case 50:    	speed = B50;
@@ -522,228 +764,3048 @@ static void setMinCount(int fd, int mcount) {
 }
 #endif // ENABLE_UART
 
-int compare_unsigned_int(const void *p1, const void *p2)
+/*
+ * feeds received bytes to the parser; returns 1 if they completed the
+ * probe message.  All bytes are consumed so that running status and
+ * partial messages carry over correctly to the next read.
+ */
+static int parse_reply(struct midi_parser *parser, const unsigned char *buf,
+		       size_t len, const unsigned char *probe, size_t probe_len)
 {
-	return *(unsigned int *)p1 - *(unsigned int *)p2;
+	struct midi_message m;
+	int found = 0;
+	size_t i;
+
+	for (i = 0; i < len; ++i) {
+		if (!midi_parser_feed(parser, buf[i], &m) || found)
+			continue;
+		if (m.length != probe_len || m.status != probe[0])
+			continue;
+		if (m.status == 0xf0) {
+			if (parser->sysex_size >= probe_len - 2 &&
+			    memcmp(parser->sysex_buf, probe + 1, probe_len - 2))
+				continue;
+		} else {
+			if (probe_len > 1 && m.data[0] != probe[1])
+				continue;
+			if (probe_len > 2 && m.data[1] != probe[2])
+				continue;
+		}
+		found = 1;
+	}
+	return found;
 }
 
-int main(int argc, char *argv[])
+static void init_link(struct link *l)
 {
-	static char short_options[] = "hVlau:y:T:g:to:i:RP:s:S:w:r123456x";
-	static struct option long_options[] = {
-		{"help", 0, NULL, 'h'},
-		{"version", 0, NULL, 'V'},
-		{"list", 0, NULL, 'l'},
-		{"raw", 0, NULL, 'a'},
-		{"uart", 1, NULL, 'u'},
-		{"system", 1, NULL, 'y'},
-		{"timeout", 1, NULL, 'T'},
-		{"grace", 1, NULL, 'g'},
-		{"terse", 0, NULL, 't'},
-		{"output", 1, NULL, 'o'},
-		{"input", 1, NULL, 'i'},
-		{"realtime", 0, NULL, 'R'},
-		{"priority", 1, NULL, 'P'},
-		{"skip", 1, NULL, 's'},
-		{"samples", 1, NULL, 'S'},
-		{"wait", 1, NULL, 'w'},
-		{"random-wait", 0, NULL, 'r'},
-		{}
-	};
-	int do_list = 0;
-	int do_realtime = 0;
-	int rt_prio = sched_get_priority_max(SCHED_FIFO);
-	unsigned int skip_samples = 0;
-	int nr_samples = 10000;
-	int random_wait = 0;
-    int precision = 1;
-    int high_precision_display = 1;
-    int debug = 1;
-	double wait = 0.0;
-	const char *output_name = NULL;
-	const char *input_name = NULL;
-	snd_seq_addr_t output_addr;
-	snd_seq_addr_t input_addr;
-	int c, err;
-	int use_rawmidi = 0;
-#ifdef ENABLE_UART
-	int use_uart = 0;
-	int uart_speed = 0;
-	const char* system_exec = NULL;
-#endif // ENABLE_UART
-	unsigned int timeout = 1000;
-	unsigned int grace = 0;
-	int verbose = 1;
+	l->pollfds = NULL;
+	l->sysex_buf = NULL;
+	l->marker_fd = -1;
+	l->times = NULL;
+	l->probe_nr = 0;
+	midi_parser_init(&l->parser, NULL, 0);
+	ump_parser_reset(&l->ump_parser);
+	pthread_mutex_init(&l->write_lock, NULL);
+}
 
-	while ((c = getopt_long(argc, argv, short_options,
-				long_options, NULL)) != -1) {
-		switch (c) {
-		case 'a':
-			use_rawmidi = 1;
-			break;
-#ifdef ENABLE_UART
-		case 'u':
-			use_uart = 1;
-			uart_speed = atoi(optarg);
-			break;
-		case 'y':
-			system_exec = optarg;
-			break;
-#endif //ENABLE_UART
-		case 'h':
-			usage(argv[0]);
-			return EXIT_SUCCESS;
-		case 'V':
-			print_version();
-			return EXIT_SUCCESS;
-		case 'l':
-			do_list = 1;
-			break;
-		case 'o':
-			output_name = optarg;
-			break;
-		case 'i':
-			input_name = optarg;
-			break;
-		case 'R':
-			do_realtime = 1;
-			break;
-		case 'P':
-			rt_prio = atoi(optarg);
-			if (rt_prio > sched_get_priority_max(SCHED_FIFO)) {
-				printf("> Warning: Given priority:   %d > sched_get_priority_max(SCHED_FIFO)! ", rt_prio);
-				printf("Setting priority to %d.\n", sched_get_priority_max(SCHED_FIFO));
-				rt_prio = sched_get_priority_max(SCHED_FIFO);
-			} else if (rt_prio < sched_get_priority_min(SCHED_FIFO)) {
-				printf("> Warning: Given priority:   %d < sched_get_priority_min(SCHED_FIFO)! ", rt_prio);
-				printf("Setting priority to %d.\n", sched_get_priority_min(SCHED_FIFO));
-				rt_prio = sched_get_priority_min(SCHED_FIFO);
-			}
-			break;
-		case 's':
-			skip_samples = atoi(optarg);
-			break;
-		case 'S':
-			nr_samples = atoi(optarg);
-			if (nr_samples <= 0) {
-				printf("> Warning: Given number of samples to take is less or equal zero! ");
-				printf("Setting nr of samples to take to 1.\n");
-				nr_samples = 1;
-			}
-			break;
-		case 'T':
-			timeout = atoi(optarg);
-			break;
-		case 'g':
-			grace = atoi(optarg);
-			break;
-		case 't':
-			verbose = 0;
-			debug = 0;
-			break;
-		case 'w':
-			wait = atof(optarg);
-			if (wait < 0) {
-				printf("> Warning: Wait time is negative; using zero.\n");
-				wait = 0;
-			}
-			break;
-		case 'r':
-			random_wait = 1;
-			break;
-        case '1':
-            precision = 1;
-            high_precision_display = 1;
-            break;
-        case '2':
-            precision = 2;
-            high_precision_display = 10;
-            break;
-        case '3':
-            precision = 3;
-            high_precision_display = 100;
-            break;
-        case '4':
-            precision = 4;
-            high_precision_display = 1000;
-            break;
-        case '5':
-            precision = 5;
-            high_precision_display = 10000;
-            break;
-        case '6':
-            precision = 6;
-            high_precision_display = 100000;
-            break;
-        case 'x':
-            debug = 0;
-            break;
-		default:
-			usage(argv[0]);
-			return EXIT_FAILURE;
-		}
+/*
+ * creates our port for a sequencer link whose addresses are already set;
+ * an output client of SND_SEQ_ADDRESS_SUBSCRIBERS sends to whatever the
+ * caller subscribes to the port
+ */
+static void open_seq_link(struct link *l)
+{
+	int err;
+
+	init_link(l);
+	l->port = snd_seq_create_simple_port(seq, "alsa-midi-latency-test",
+					     SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SYNC_WRITE,
+					     SND_SEQ_PORT_TYPE_APPLICATION);
+	check_snd("create port", l->port);
+	if (l->output_addr.client != SND_SEQ_ADDRESS_SUBSCRIBERS) {
+		err = snd_seq_connect_to(seq, l->port, l->output_addr.client, l->output_addr.port);
+		check_snd("connect output port", err);
 	}
-	if (argc == 1 || argv[optind]) {
-		usage(argv[0]);
-		return EXIT_FAILURE;
+	err = snd_seq_connect_from(seq, l->port, l->input_addr.client, l->input_addr.port);
+	check_snd("connect input port", err);
+
+	err = snd_midi_event_new(SEND_CHUNK, &l->encoder);
+	check_snd("create MIDI event encoder", err);
+	err = snd_midi_event_new(sizeof(l->rec_buf), &l->decoder);
+	check_snd("create MIDI event decoder", err);
+	snd_midi_event_no_status(l->decoder, 1);
+}
+
+/*
+ * like parse_reply(), for a stream of packets; utility messages such as
+ * JR Timestamps are skipped
+ */
+static int parse_ump_reply(struct ump_parser *parser, const unsigned char *buf,
+			   size_t len, const struct probe *p)
+{
+	const unsigned int *packet = p->ump + p->ump_first;
+	int words = p->len / sizeof(*p->ump) - p->ump_first;
+	unsigned int word;
+	int n, found = 0;
+	size_t i;
+
+	for (i = 0; i + sizeof(word) <= len; i += sizeof(word)) {
+		memcpy(&word, buf + i, sizeof(word));
+		n = ump_parser_feed(parser, word);
+		if (!n || found || !(parser->words[0] >> 28))
+			continue;
+		if (n == words && !memcmp(parser->words, packet, n * sizeof(word)))
+			found = 1;
 	}
+	return found;
+}
 
-	int use_seq = 1;
-	// temporarily change the ALSA error handler to silence warning in case
-	// /dev/snd/seq doesn't exist (e.g.: lacks kernel support or module not
-	// loaded)
-	snd_lib_error_set_handler(quiet_error_handler);
-	err = snd_seq_open(&seq, "default", SND_SEQ_OPEN_DUPLEX, 0);
-	snd_lib_error_set_handler(NULL); // restore default handler
-	if (err)
-		use_seq = 0;
+static void open_link(struct link *l, int uart_speed)
+{
+	int err;
 
-	if (do_list) {
-		list_ports();
-		return 0;
+	if (l->type == LINK_SEQ) {
+		err = snd_seq_parse_address(seq, &l->output_addr, l->output_name);
+		check_snd("parse output port", err);
+		err = snd_seq_parse_address(seq, &l->input_addr, l->input_name);
+		check_snd("parse input port", err);
+		open_seq_link(l);
+		return;
 	}
 
-	if (!output_name)
-		fatal("Please specify an output port with --output.  Use -l to get a list.");
-	if (!input_name)
-		fatal("Please specify an input port with --input.  Use -l to get a list.");
-	// ensure that exactly one of rawmidi or seq is enabled
-	if (use_rawmidi)
-		use_seq = 0;
-	else
-		use_rawmidi = !use_seq;
+	init_link(l);
+	switch (l->type) {
+	case LINK_RAWMIDI:
+		err = snd_rawmidi_open(&l->raw_in, NULL, l->input_name, SND_RAWMIDI_NONBLOCK);
+		check_snd("open input", err);
+		err = snd_rawmidi_open(NULL, &l->raw_out, l->output_name, SND_RAWMIDI_SYNC);
+		check_snd("open output", err);
+		break;
+#ifdef ENABLE_UART
+	case LINK_UART:
+		l->uart_fd_in = open(l->input_name, O_RDWR | O_NOCTTY | O_SYNC | O_NONBLOCK);
+		if (l->uart_fd_in < 0)
+			check_posix("open input", errno);
+		l->uart_fd_out = open(l->output_name, O_RDWR | O_NOCTTY | O_SYNC);
+		if (l->uart_fd_out < 0)
+			check_posix("open output", errno);
+		unsigned int baudRate = speedToBaudRate(uart_speed);
+		if (B0 == baudRate)
+			fatal("Error setting BAUD rate: %d speed not supported", uart_speed);
+		setInterfaceAttribs(l->uart_fd_in, baudRate);
+		setInterfaceAttribs(l->uart_fd_out, baudRate);
+		setMinCount(l->uart_fd_in, 0); /* set to pure timed read */
+		setMinCount(l->uart_fd_out, 0); /* set to pure timed read */
+		break;
+#endif // ENABLE_UART
+#ifdef ENABLE_UMP
+	case LINK_UMP:
+		err = snd_ump_open(&l->ump_in, NULL, l->input_name, SND_RAWMIDI_NONBLOCK);
+		check_snd("open UMP input", err);
+		err = snd_ump_open(NULL, &l->ump_out, l->output_name, SND_RAWMIDI_SYNC);
+		check_snd("open UMP output", err);
+		break;
+#endif // ENABLE_UMP
+	}
+}
+
+/* gets the poll descriptors of the input side and primes them */
+static void prepare_link(struct link *l)
+{
+	int err = 0;
+
+	switch (l->type) {
+	case LINK_SEQ:
+		l->pollfds_count = snd_seq_poll_descriptors_count(seq, POLLIN);
+		l->pollfds = calloc(l->pollfds_count, sizeof *l->pollfds);
+		check_mem(l->pollfds);
+		err = snd_seq_poll_descriptors(seq, l->pollfds, l->pollfds_count, POLLIN);
+		break;
+	case LINK_RAWMIDI:
+		l->pollfds_count = snd_rawmidi_poll_descriptors_count(l->raw_in);
+		l->pollfds = calloc(l->pollfds_count, sizeof *l->pollfds);
+		check_mem(l->pollfds);
+		err = snd_rawmidi_poll_descriptors(l->raw_in, l->pollfds, l->pollfds_count);
+		snd_rawmidi_drain(l->raw_in);
+		snd_rawmidi_drain(l->raw_out);
+		// not sure if this is documented anwhere, but in practical
+		// applications we find that one needs to poll() at least once
+		// before incoming messages start being queued.
+		// skipping this dummy poll() here would result in the first
+		// response message not being received if the roundtrip is so
+		// fast that the first call to poll() happens after the
+		// device has sent back its response
+		poll(l->pollfds, l->pollfds_count, 0);
+		break;
+#ifdef ENABLE_UART
+	case LINK_UART:
+		l->pollfds = calloc(1, sizeof *l->pollfds);
+		check_mem(l->pollfds);
+		l->pollfds[0].fd = l->uart_fd_in;
+		l->pollfds[0].events = POLLIN;
+		poll(l->pollfds, 1, 0);
+		err = 1;
+		break;
+#endif // ENABLE_UART
+#ifdef ENABLE_UMP
+	case LINK_UMP:
+		l->pollfds_count = snd_ump_poll_descriptors_count(l->ump_in);
+		l->pollfds = calloc(l->pollfds_count, sizeof *l->pollfds);
+		check_mem(l->pollfds);
+		err = snd_ump_poll_descriptors(l->ump_in, l->pollfds, l->pollfds_count);
+		/* the same dummy poll() as for rawmidi */
+		poll(l->pollfds, l->pollfds_count, 0);
+		break;
+#endif // ENABLE_UMP
+	}
+	check_snd("get poll descriptors", err);
+	l->pollfds_count = err;
+}
+
+static void close_link(struct link *l)
+{
+	switch (l->type) {
+	case LINK_SEQ:
+		snd_midi_event_free(l->encoder);
+		snd_midi_event_free(l->decoder);
+		break;
+	case LINK_RAWMIDI:
+		snd_rawmidi_close(l->raw_in);
+		snd_rawmidi_close(l->raw_out);
+		break;
+#ifdef ENABLE_UART
+	case LINK_UART:
+		close(l->uart_fd_in);
+		close(l->uart_fd_out);
+		break;
+#endif // ENABLE_UART
+#ifdef ENABLE_UMP
+	case LINK_UMP:
+		snd_ump_close(l->ump_in);
+		snd_ump_close(l->ump_out);
+		break;
+#endif // ENABLE_UMP
+	}
+	free(l->pollfds);
+	free(l->sysex_buf);
+	l->pollfds = NULL;
+	l->sysex_buf = NULL;
+	pthread_mutex_destroy(&l->write_lock);
+}
+
+/* makes the parser keep SysEx payloads of up to size bytes for matching */
+static void link_expect_sysex(struct link *l, size_t size)
+{
+	free(l->sysex_buf);
+	l->sysex_buf = malloc(size);
+	check_mem(l->sysex_buf);
+	midi_parser_init(&l->parser, l->sysex_buf, size);
+}
+
+static void seq_event_init(const struct link *l, snd_seq_event_t *ev)
+{
+	snd_seq_ev_clear(ev);
+	if (l->output_addr.client == SND_SEQ_ADDRESS_SUBSCRIBERS)
+		snd_seq_ev_set_subs(ev);
+	else
+		snd_seq_ev_set_dest(ev, l->output_addr.client, l->output_addr.port);
+	snd_seq_ev_set_source(ev, l->port);
+	snd_seq_ev_set_direct(ev);
+}
+
+/* sets up the probe, so that sending it does no more work than needed */
+static void encode_probe(const struct link *l, snd_midi_event_t *encoder,
+			 struct probe *p, const unsigned char *msg, size_t len)
+{
+	long err;
+
+	p->msg = msg;
+	p->len = len;
+	if (l->type != LINK_SEQ || msg[0] == 0xf0)
+		return;
+	seq_event_init(l, &p->ev);
+	snd_midi_event_reset_encode(encoder);
+	err = snd_midi_event_encode(encoder, msg, len, &p->ev);
+	if (err < 0 || p->ev.type == SND_SEQ_EVENT_NONE)
+		fatal("cannot encode probe message %02x", msg[0]);
+}
+
+/*
+ * translates a MIDI 1.0 probe into a packet, preceded by a JR Timestamp
+ * of the current time with --ump-jr
+ */
+static void set_ump_probe(const struct link *l, struct probe *p,
+			  const unsigned char *msg, size_t len)
+{
+	struct timespec now;
+	int n = 0;
+
+	if (l->ump_jr) {
+		/* JR clock ticks are 1/31250 s */
+		clock_gettime(HR_CLOCK, &now);
+		p->ump[n++] = ump_jr_timestamp(now.tv_sec * 31250 + now.tv_nsec / 32000);
+	}
+	p->ump_first = n;
+	n += ump_from_midi1(l->ump_bits, msg, len, p->ump + n);
+	p->msg = (const unsigned char *)p->ump;
+	p->len = n * sizeof(*p->ump);
+}
+
+static void set_probe(const struct link *l, struct probe *p,
+		      const unsigned char *msg, size_t len)
+{
+	if (l->ump_bits)
+		set_ump_probe(l, p, msg, len);
+	else
+		encode_probe(l, l->encoder, p, msg, len);
+}
+
+#ifdef ENABLE_UMP
+static int write_seq_ump(const struct link *l, const struct probe *p)
+{
+	snd_seq_ump_event_t ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.flags = SND_SEQ_EVENT_UMP;
+	ev.queue = SND_SEQ_QUEUE_DIRECT;
+	ev.source.port = l->port;
+	if (l->output_addr.client == SND_SEQ_ADDRESS_SUBSCRIBERS) {
+		ev.dest.client = SND_SEQ_ADDRESS_SUBSCRIBERS;
+		ev.dest.port = SND_SEQ_ADDRESS_UNKNOWN;
+	} else {
+		ev.dest = l->output_addr;
+	}
+	memcpy(ev.ump, p->ump + p->ump_first, p->len - p->ump_first * sizeof(*p->ump));
+	return snd_seq_ump_event_output_direct(seq, &ev);
+}
+
+/* a sequencer client in UMP mode gets every event as a packet */
+static long read_seq_ump(struct link *l)
+{
+	snd_seq_ump_event_t *ev;
+	int err, words;
+
+	err = snd_seq_ump_event_input(seq, &ev);
+	check_snd("input UMP event", err);
+	if (!(ev->flags & SND_SEQ_EVENT_UMP))
+		return 0;
+	words = ump_packet_words(ev->ump[0]);
+	memcpy(l->rec_buf, ev->ump, words * sizeof(ev->ump[0]));
+	return words * sizeof(ev->ump[0]);
+}
+#endif // ENABLE_UMP
+
+static void write_part(const struct link *l, const struct probe *p,
+		       const unsigned char *buf, size_t len)
+{
+	snd_seq_event_t ev;
+	ssize_t err = 0;
+
+	switch (l->type) {
+	case LINK_SEQ:
+#ifdef ENABLE_UMP
+		if (l->ump_bits) {
+			err = write_seq_ump(l, p);
+			break;
+		}
+#endif // ENABLE_UMP
+		if (p->msg[0] != 0xf0) {
+			err = snd_seq_event_output_direct(seq, (snd_seq_event_t *)&p->ev);
+			break;
+		}
+		/* SysEx goes out as variable length events */
+		seq_event_init(l, &ev);
+		snd_seq_ev_set_sysex(&ev, len, (void *)buf);
+		err = snd_seq_event_output_direct(seq, &ev);
+		break;
+	case LINK_RAWMIDI:
+		err = snd_rawmidi_write(l->raw_out, buf, len);
+		break;
+#ifdef ENABLE_UART
+	case LINK_UART:
+		while (len > 0) {
+			err = write(l->uart_fd_out, buf, len);
+			if (err <= 0)
+				check_posix("output UART event", err ? errno : EIO);
+			buf += err;
+			len -= err;
+		}
+		break;
+#endif // ENABLE_UART
+#ifdef ENABLE_UMP
+	case LINK_UMP:
+		err = snd_ump_write(l->ump_out, buf, len);
+		break;
+#endif // ENABLE_UMP
+	}
+	check_snd("output MIDI event", err);
+}
+
+/*
+ * reads what arrived on an input that poll() found readable into
+ * rec_buf; returns the number of bytes, or 0
+ */
+static long read_input(struct link *l)
+{
+	snd_seq_event_t *rec_ev;
+	long err = 0;
+
+	switch (l->type) {
+	case LINK_SEQ:
+#ifdef ENABLE_UMP
+		if (l->ump_bits)
+			return read_seq_ump(l);
+#endif // ENABLE_UMP
+		err = snd_seq_event_input(seq, &rec_ev);
+		check_snd("input MIDI event", err);
+		err = snd_midi_event_decode(l->decoder, l->rec_buf, sizeof(l->rec_buf), rec_ev);
+		break;
+	case LINK_RAWMIDI:
+		err = snd_rawmidi_read(l->raw_in, l->rec_buf, sizeof(l->rec_buf));
+		if (err == -EAGAIN)
+			return 0;
+		check_snd("input MIDI event", err);
+		break;
+#ifdef ENABLE_UART
+	case LINK_UART:
+		err = read(l->uart_fd_in, l->rec_buf, sizeof(l->rec_buf));
+		if (err < 0 && (errno == EAGAIN || errno == EINTR))
+			return 0;
+		if (err < 0)
+			check_posix("input UART event", errno);
+		break;
+#endif // ENABLE_UART
+#ifdef ENABLE_UMP
+	case LINK_UMP:
+		err = snd_ump_read(l->ump_in, l->rec_buf, sizeof(l->rec_buf));
+		if (err == -EAGAIN)
+			return 0;
+		check_snd("input UMP packet", err);
+		break;
+#endif // ENABLE_UMP
+	}
+	return err > 0 ? err : 0;
+}
+
+/* the poll events of a link's input, from its part of a poll() array */
+static unsigned short link_revents(const struct link *l, struct pollfd *pollfds)
+{
+	unsigned short revents = 0;
+	int err;
+
+	switch (l->type) {
+	case LINK_SEQ:
+		err = snd_seq_poll_descriptors_revents(seq, pollfds, l->pollfds_count, &revents);
+		check_snd("get poll events", err);
+		break;
+	case LINK_RAWMIDI:
+		err = snd_rawmidi_poll_descriptors_revents(l->raw_in, pollfds, l->pollfds_count, &revents);
+		check_snd("get poll events", err);
+		break;
+#ifdef ENABLE_UART
+	case LINK_UART:
+		revents = pollfds[0].revents;
+		break;
+#endif // ENABLE_UART
+#ifdef ENABLE_UMP
+	case LINK_UMP:
+		err = snd_ump_poll_descriptors_revents(l->ump_in, pollfds, l->pollfds_count, &revents);
+		check_snd("get poll events", err);
+		break;
+#endif // ENABLE_UMP
+	}
+	return revents;
+}
+
+/*
+ * polls the input once and parses whatever arrived.  Returns 1 if that
+ * completed the probe (and stores the time in *end), 0 if it did not,
+ * -1 if interrupted or the input went away, and -2 on timeout.
+ */
+static int read_reply(struct link *l, const struct probe *p,
+		      int timeout, struct timespec *end)
+{
+	unsigned short revents;
+	long err;
+
+	err = poll(l->pollfds, l->pollfds_count, timeout);
+	if (signal_received)
+		return -1;
+	if (err == 0)
+		return -2;
+	if (err < 0)
+		fatal("poll error: %s", strerror(errno));
+	revents = link_revents(l, l->pollfds);
+	if (revents & (POLLERR | POLLNVAL))
+		return -1;
+	if (!(revents & POLLIN))
+		return 0;
+	if (l->times)
+		l->times->wake = trace_now();
+	err = read_input(l);
+	if (err > 0 && (l->ump_bits ? parse_ump_reply(&l->ump_parser, l->rec_buf, err, p) :
+			parse_reply(&l->parser, l->rec_buf, err, p->msg, p->len))) {
+		clock_gettime(HR_CLOCK, end);
+		if (l->times)
+			l->times->end = trace_now();
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * sends the probe.  Long SysEx probes are written in parts, using the
+ * loop back as flow control so that no more than SEND_WINDOW bytes are
+ * in flight; otherwise the device or the input buffer would overflow
+ * while this thread is busy writing.  Returns read_reply()'s result if
+ * the reply had to be read while sending, or 0.
+ */
+static int send_probe(struct link *l, const struct probe *p,
+		      unsigned int timeout, struct timespec *end)
+{
+	size_t pos, n, received;
+	int err;
+
+	if (p->len <= SEND_CHUNK) {
+		write_part(l, p, p->msg, p->len);
+		return 0;
+	}
+	for (pos = 0; pos < p->len; pos += n) {
+		n = p->len - pos;
+		if (n > SEND_CHUNK)
+			n = SEND_CHUNK;
+		write_part(l, p, p->msg + pos, n);
+		for (;;) {
+			received = l->parser.in_sysex ? l->parser.sysex_len + 1 : 0;
+			if (pos + n <= received + SEND_WINDOW)
+				break;
+			err = read_reply(l, p, timeout, end);
+			if (err)
+				return err;
+		}
+	}
+	return 0;
+}
+
+/* waits until the probe comes back; returns read_reply()'s final result */
+static int receive_probe(struct link *l, const struct probe *p,
+			 unsigned int timeout, struct timespec *end)
+{
+	int err;
+
+	while (!(err = read_reply(l, p, timeout, end)))
+		;
+	return err;
+}
+
+static unsigned long long timespec_sub_ns(const struct timespec *a,
+					  const struct timespec *b)
+{
+	return (long long)(a->tv_sec - b->tv_sec) * 1000000000LL +
+		(a->tv_nsec - b->tv_nsec);
+}
+
+/*
+ * takes one roundtrip sample; returns 1, 0 if interrupted, or -2 if the
+ * probe did not come back in time.  Trace markers are written outside of
+ * the timed interval, as each costs a syscall.
+ */
+static int probe_roundtrip(struct link *l, const struct probe *p,
+			   unsigned int timeout, struct timespec *begin,
+			   struct timespec *end)
+{
+	int err;
+
+	if (l->marker_fd >= 0)
+		trace_mark(l->marker_fd, "alsa-midi-latency-test: probe %u send\n", l->probe_nr);
+	clock_gettime(HR_CLOCK, begin);
+	if (l->times) {
+		memset(l->times, 0, sizeof(*l->times));
+		l->times->begin = trace_now();
+	}
+	pthread_mutex_lock(&l->write_lock);
+	err = send_probe(l, p, timeout, end);
+	pthread_mutex_unlock(&l->write_lock);
+	if (l->times)
+		l->times->sent = trace_now();
+	if (!err)
+		err = receive_probe(l, p, timeout, end);
+	if (err > 0 && l->marker_fd >= 0)
+		trace_mark(l->marker_fd, "alsa-midi-latency-test: probe %u received after %llu ns\n",
+			   l->probe_nr, timespec_sub_ns(end, begin));
+	l->probe_nr++;
+	return err == -1 ? 0 : err;
+}
+
+/* takes one roundtrip sample; returns 0 if interrupted */
+static int measure_probe(struct link *l, const struct probe *p,
+			 unsigned int timeout, struct timespec *begin,
+			 struct timespec *end)
+{
+	int err = probe_roundtrip(l, p, timeout, begin, end);
+
+	if (err == -2)
+		fatal("timeout: there seems to be no connection between ports %s and %s", l->output_name, l->input_name);
+	return err;
+}
+
+/* background messages sent on the probe's output, see --clock etc. */
+struct traffic_source {
+	const char *name;
+	unsigned long long period_ns;
+	unsigned long long next_ns;
+	unsigned char *msg;
+	size_t len;
+	int vary;		/* second data byte counts up */
+	struct probe probe;
+	unsigned long sent;
+};
+
+struct traffic {
+	struct link *link;
+	struct traffic_source sources[4];
+	int nr_sources;
+	snd_midi_event_t *encoder;
+	pthread_t thread;
+	volatile int enabled;
+	volatile int stop;
+	unsigned long long bytes_sent;
+};
+
+static void add_traffic(struct traffic *t, const char *name, double rate_hz,
+			const unsigned char *msg, size_t len, int vary)
+{
+	struct traffic_source *s;
+
+	if (t->nr_sources >= (int)ARRAY_SIZE(t->sources))
+		fatal("too many background traffic sources");
+	if (rate_hz <= 0)
+		fatal("invalid rate for background %s", name);
+	s = &t->sources[t->nr_sources++];
+	memset(s, 0, sizeof(*s));
+	s->name = name;
+	s->period_ns = 1000000000.0 / rate_hz;
+	s->msg = malloc(len);
+	check_mem(s->msg);
+	memcpy(s->msg, msg, len);
+	s->len = len;
+	s->vary = vary;
+}
+
+/* writes a whole message while holding the link's write lock */
+static void write_message(struct link *l, const struct probe *p)
+{
+	size_t pos, n;
+
+	pthread_mutex_lock(&l->write_lock);
+	for (pos = 0; pos < p->len; pos += n) {
+		n = p->len - pos;
+		if (n > SEND_CHUNK)
+			n = SEND_CHUNK;
+		write_part(l, p, p->msg + pos, n);
+	}
+	pthread_mutex_unlock(&l->write_lock);
+}
+
+static void *traffic_thread(void *arg)
+{
+	struct traffic *t = arg;
+	struct traffic_source *s;
+	struct timespec ts;
+	unsigned long long now, next;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	for (i = 0; i < t->nr_sources; ++i)
+		t->sources[i].next_ns = now + t->sources[i].period_ns;
+
+	while (!t->stop && !signal_received) {
+		/* wake up at least every 50 ms to notice t->stop */
+		next = now + 50000000;
+		for (i = 0; i < t->nr_sources; ++i)
+			if (t->sources[i].next_ns < next)
+				next = t->sources[i].next_ns;
+		ts.tv_sec = next / 1000000000;
+		ts.tv_nsec = next % 1000000000;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+		for (i = 0; i < t->nr_sources; ++i) {
+			s = &t->sources[i];
+			if (s->next_ns > now)
+				continue;
+			s->next_ns += s->period_ns;
+			if (s->next_ns <= now)	/* fell behind; don't burst */
+				s->next_ns = now + s->period_ns;
+			if (!t->enabled)
+				continue;
+			if (s->vary) {
+				s->msg[2] = (s->msg[2] + 1) & 0x7f;
+				encode_probe(t->link, t->encoder, &s->probe, s->msg, s->len);
+			}
+			write_message(t->link, &s->probe);
+			s->sent++;
+			t->bytes_sent += s->len;
+		}
+	}
+	return NULL;
+}
+
+static void start_traffic(struct traffic *t, struct link *l)
+{
+	int i, err;
+
+	t->link = l;
+	t->enabled = 0;
+	t->stop = 0;
+	t->bytes_sent = 0;
+	t->encoder = NULL;
+	if (l->type == LINK_SEQ) {
+		err = snd_midi_event_new(SEND_CHUNK, &t->encoder);
+		check_snd("create MIDI event encoder", err);
+	}
+	for (i = 0; i < t->nr_sources; ++i)
+		encode_probe(l, t->encoder, &t->sources[i].probe,
+			     t->sources[i].msg, t->sources[i].len);
+	err = pthread_create(&t->thread, NULL, traffic_thread, t);
+	check_posix("create traffic thread", err);
+}
+
+static void stop_traffic(struct traffic *t)
+{
+	int i;
+
+	t->stop = 1;
+	pthread_join(t->thread, NULL);
+	if (t->encoder)
+		snd_midi_event_free(t->encoder);
+	for (i = 0; i < t->nr_sources; ++i)
+		free(t->sources[i].msg);
+}
+
+static int compare_ull(const void *p1, const void *p2)
+{
+	unsigned long long a = *(const unsigned long long *)p1;
+	unsigned long long b = *(const unsigned long long *)p2;
+
+	return a < b ? -1 : a > b;
+}
+
+/* least squares fit of y = fixed + slope * x */
+struct line_fit {
+	double sum_x, sum_y, sum_xx, sum_xy;
+	unsigned int n;
+};
+
+static void fit_add(struct line_fit *f, double x, double y)
+{
+	f->sum_x += x;
+	f->sum_y += y;
+	f->sum_xx += x * x;
+	f->sum_xy += x * y;
+	f->n++;
+}
+
+static int fit_solve(const struct line_fit *f, double *fixed, double *slope)
+{
+	double denom = f->n * f->sum_xx - f->sum_x * f->sum_x;
+
+	if (f->n < 2 || denom <= 0)
+		return 0;
+	*slope = (f->n * f->sum_xy - f->sum_x * f->sum_y) / denom;
+	*fixed = (f->sum_y - *slope * f->sum_x) / f->n;
+	return 1;
+}
+
+/* median of n sorted values, in ms */
+static double median_ms(const unsigned long long *sorted, unsigned int n)
+{
+	if (n & 1)
+		return sorted[n / 2] / 1000000.0;
+	return (sorted[n / 2 - 1] + sorted[n / 2]) / 2000000.0;
+}
+
+/*
+ * takes up to nr_samples of the probe, which is rebuilt by update (if
+ * given) before each one; returns how many were taken
+ */
+static int sample_probe(struct link *l, struct probe *p, int nr_samples,
+			unsigned int timeout, double wait, int random_wait,
+			void (*update)(struct link *, struct probe *, int),
+			unsigned long long *delays)
+{
+	struct timespec begin, end;
+	int i, n = 0;
+
+	for (i = 0; i < nr_samples; ++i) {
+		if (wait) {
+			if (random_wait)
+				wait_ms(wait + rand() * wait / RAND_MAX);
+			else
+				wait_ms(wait);
+		}
+		if (signal_received)
+			break;
+		if (update)
+			update(l, p, i);
+		if (!measure_probe(l, p, timeout, &begin, &end))
+			break;
+		delays[n++] = timespec_sub_ns(&end, &begin);
+	}
+	qsort(delays, n, sizeof(delays[0]), compare_ull);
+	return n;
+}
+
+/* builds a SysEx probe of len bytes in total, F0 and F7 included */
+static void fill_sysex(unsigned char *msg, size_t len, unsigned int tag)
+{
+	size_t i;
+
+	msg[0] = 0xf0;
+	for (i = 1; i < len - 1; ++i)
+		msg[i] = (i + tag) & 0x7f;
+	if (len > 2)
+		msg[1] = 0x7d;	/* non-commercial manufacturer ID */
+	msg[len - 1] = 0xf7;
+}
+
+static unsigned char *sweep_msg;
+
+static void update_sysex(struct link *l, struct probe *p, int i)
+{
+	fill_sysex(sweep_msg, p->len, i);
+	set_probe(l, p, sweep_msg, p->len);
+}
+
+/*
+ * sends SysEx probes of doubling size from min_size to max_size bytes,
+ * and fits latency = fixed + size * per_byte over the per-size medians
+ */
+static int run_sysex_sweep(struct link *l, size_t min_size, size_t max_size,
+			   int nr_samples, unsigned int timeout, double wait,
+			   int random_wait, int verbose, int uart_speed)
+{
+	unsigned long long *delays;
+	struct probe probe;
+	struct line_fit fit = { 0 };
+	double fixed, per_byte;
+	size_t size;
+	int n;
+
+	sweep_msg = malloc(max_size);
+	check_mem(sweep_msg);
+	delays = calloc(nr_samples, sizeof *delays);
+	check_mem(delays);
+	link_expect_sysex(l, max_size);
+
+	if (verbose) {
+		printf("\n> SysEx size sweep from %zu to %zu bytes, %d samples per size\n\n",
+		       min_size, max_size, nr_samples);
+		printf("     bytes  samples     min_ms  median_ms     max_ms      bytes/s\n");
+	}
+
+	for (size = min_size; !signal_received;
+	     size = size * 2 > max_size ? max_size : size * 2) {
+		/* allow for the transfer itself at 31250 baud, both ways */
+		unsigned int wire_rate = uart_speed ? uart_speed : 31250;
+		unsigned int step_timeout = timeout + size * 20000 / wire_rate;
+
+		probe.len = size;
+		n = sample_probe(l, &probe, nr_samples, step_timeout, wait,
+				 random_wait, update_sysex, delays);
+		if (!n)
+			break;
+
+		double median = median_ms(delays, n);
+		if (verbose)
+			printf("%10zu %8d %10.3f %10.3f %10.3f %12.0f\n",
+			       size, n, delays[0] / 1000000.0, median,
+			       delays[n - 1] / 1000000.0, size / (median / 1000.0));
+		else
+			printf("%zu, %d, %.3f, %.3f, %.3f, %.0f\n",
+			       size, n, delays[0] / 1000000.0, median,
+			       delays[n - 1] / 1000000.0, size / (median / 1000.0));
+
+		fit_add(&fit, size, median);
+		if (size == max_size)
+			break;
+	}
+
+	if (fit_solve(&fit, &fixed, &per_byte)) {
+		if (verbose) {
+			printf("\n> cost model (least squares over the medians):\n\n");
+			printf(" fixed    cost is %.3f ms\n", fixed);
+			printf(" per-byte cost is %.3f us", per_byte * 1000.0);
+			if (per_byte > 0)
+				printf(" (%.0f bytes/s)", 1000.0 / per_byte);
+			puts("");
+#ifdef ENABLE_UART
+			if (l->type == LINK_UART) {
+				/* start bit, 8 data bits and stop bit */
+				double wire = 10000.0 / uart_speed; /* ms per byte */
+				printf(" UART wire time at %d baud is %.3f us per byte (%.0f bytes/s),\n",
+				       uart_speed, wire * 1000.0, 1000.0 / wire);
+				printf(" measured / wire = %.2f\n", per_byte / wire);
+			}
+#endif // ENABLE_UART
+		} else {
+			printf("fit, %.3f, %.3f\n", fixed, per_byte * 1000.0);
+		}
+	}
+
+	free(delays);
+	free(sweep_msg);
+	return fit.n ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * in-process sequencer clients that forward (or just swallow) every
+ * event they get, to measure what each routing hop costs
+ */
+struct forwarder {
+	snd_seq_t *seq;
+	int client;
+	int port;
+	int discard;
+	pthread_t thread;
+	volatile int stop;
+};
+
+static void *forwarder_thread(void *arg)
+{
+	struct forwarder *f = arg;
+	snd_seq_event_t *ev;
+	struct pollfd pfd[4];
+	int n;
+
+	n = snd_seq_poll_descriptors(f->seq, pfd, ARRAY_SIZE(pfd), POLLIN);
+	while (!f->stop && !signal_received) {
+		if (poll(pfd, n, 50) <= 0)
+			continue;
+		while (snd_seq_event_input(f->seq, &ev) >= 0) {
+			if (f->discard)
+				continue;
+			snd_seq_ev_set_source(ev, f->port);
+			snd_seq_ev_set_subs(ev);
+			snd_seq_ev_set_direct(ev);
+			snd_seq_event_output_direct(f->seq, ev);
+		}
+	}
+	return NULL;
+}
+
+static void start_forwarder(struct forwarder *f, const char *role, int nr,
+			    int discard)
+{
+	char name[64];
+	int err;
+
+	err = snd_seq_open(&f->seq, "default", SND_SEQ_OPEN_DUPLEX, SND_SEQ_NONBLOCK);
+	check_snd("open sequencer", err);
+	snprintf(name, sizeof(name), "alsa-midi-latency-test %s %d", role, nr);
+	err = snd_seq_set_client_name(f->seq, name);
+	check_snd("set client name", err);
+	f->client = snd_seq_client_id(f->seq);
+	check_snd("get client id", f->client);
+	f->port = snd_seq_create_simple_port(f->seq, name,
+					     SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ |
+					     SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE,
+					     SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+	check_snd("create port", f->port);
+	f->discard = discard;
+	f->stop = 0;
+	err = pthread_create(&f->thread, NULL, forwarder_thread, f);
+	check_posix("create forwarder thread", err);
+}
+
+static void stop_forwarder(struct forwarder *f)
+{
+	f->stop = 1;
+	pthread_join(f->thread, NULL);
+	snd_seq_close(f->seq);
+}
+
+static void connect_forwarders(const struct forwarder *from,
+			       const struct forwarder *to)
+{
+	int err = snd_seq_connect_to(from->seq, from->port, to->client, to->port);
+	check_snd("connect forwarders", err);
+}
+
+/*
+ * measures one routing topology: the probe goes to the subscribers of
+ * our port, which are first[] (in that order), and comes back from last
+ */
+static int measure_route(struct forwarder *first, int nr_first,
+			 const struct forwarder *last, int nr_samples,
+			 unsigned int timeout, double wait, int random_wait,
+			 unsigned long long *delays)
+{
+	static const unsigned char msg[3] = { 0x90, 60, 127 };
+	struct link l;
+	struct probe probe;
+	int i, n;
+
+	memset(&l, 0, sizeof(l));
+	l.type = LINK_SEQ;
+	l.output_name = "subscribers";
+	l.input_name = "forwarders";
+	l.output_addr.client = SND_SEQ_ADDRESS_SUBSCRIBERS;
+	l.input_addr.client = last->client;
+	l.input_addr.port = last->port;
+	open_seq_link(&l);
+	for (i = 0; i < nr_first; ++i) {
+		int err = snd_seq_connect_to(seq, l.port, first[i].client, first[i].port);
+		check_snd("connect forwarder", err);
+	}
+	prepare_link(&l);
+	set_probe(&l, &probe, msg, sizeof(msg));
+	n = sample_probe(&l, &probe, nr_samples, timeout, wait, random_wait,
+			 NULL, delays);
+	close_link(&l);
+	snd_seq_delete_simple_port(seq, l.port);
+	return n;
+}
+
+static void print_route_step(const char *what, int count, int n,
+			     const unsigned long long *delays, int verbose)
+{
+	if (verbose)
+		printf("%10d %8d %10.3f %10.3f %10.3f\n", count, n,
+		       delays[0] / 1000000.0, median_ms(delays, n),
+		       delays[n - 1] / 1000000.0);
+	else
+		printf("%s, %d, %d, %.3f, %.3f, %.3f\n", what, count, n,
+		       delays[0] / 1000000.0, median_ms(delays, n),
+		       delays[n - 1] / 1000000.0);
+}
+
+static void print_route_fit(const char *what, const struct line_fit *fit,
+			    int verbose)
+{
+	double fixed, slope;
+
+	if (!fit_solve(fit, &fixed, &slope))
+		return;
+	if (verbose)
+		printf("\n> cost per %s is %.3f us (fixed %.3f ms)\n\n",
+		       what, slope * 1000.0, fixed);
+	else
+		printf("%s-fit, %.3f, %.3f\n", what, fixed, slope * 1000.0);
+}
+
+/*
+ * routes the probe through chains of 1 .. chain_max forwarding clients,
+ * then fans it out to 1 .. fanout_max subscribers of which only the last
+ * one sends it back, doubling the count at each step
+ */
+static int run_seq_routing(int chain_max, int fanout_max, int nr_samples,
+			   unsigned int timeout, double wait, int random_wait,
+			   int verbose)
+{
+	struct forwarder *fw;
+	struct line_fit fit;
+	unsigned long long *delays;
+	int count, i, n, steps = 0;
+
+	fw = calloc(chain_max > fanout_max ? chain_max : fanout_max, sizeof(*fw));
+	check_mem(fw);
+	delays = calloc(nr_samples, sizeof *delays);
+	check_mem(delays);
+
+	if (chain_max && verbose) {
+		printf("\n> sequencer chains of 1 to %d forwarding clients, %d samples each\n\n",
+		       chain_max, nr_samples);
+		printf("      hops  samples     min_ms  median_ms     max_ms\n");
+	}
+	memset(&fit, 0, sizeof(fit));
+	for (count = 1; chain_max && !signal_received;
+	     count = count * 2 > chain_max ? chain_max : count * 2) {
+		for (i = 0; i < count; ++i)
+			start_forwarder(&fw[i], "hop", i + 1, 0);
+		for (i = 0; i + 1 < count; ++i)
+			connect_forwarders(&fw[i], &fw[i + 1]);
+		n = measure_route(fw, 1, &fw[count - 1], nr_samples, timeout,
+				  wait, random_wait, delays);
+		for (i = 0; i < count; ++i)
+			stop_forwarder(&fw[i]);
+		if (!n)
+			break;
+		print_route_step("chain", count, n, delays, verbose);
+		fit_add(&fit, count, median_ms(delays, n));
+		++steps;
+		if (count == chain_max)
+			break;
+	}
+	print_route_fit("hop", &fit, verbose);
+
+	if (fanout_max && verbose) {
+		printf("\n> fan-out to 1 to %d subscribers, %d samples each\n\n",
+		       fanout_max, nr_samples);
+		printf("      subs  samples     min_ms  median_ms     max_ms\n");
+	}
+	memset(&fit, 0, sizeof(fit));
+	for (count = 1; fanout_max && !signal_received;
+	     count = count * 2 > fanout_max ? fanout_max : count * 2) {
+		/* the echoing subscriber is delivered to last */
+		for (i = 0; i < count; ++i)
+			start_forwarder(&fw[i], "subscriber", i + 1, i + 1 < count);
+		n = measure_route(fw, count, &fw[count - 1], nr_samples,
+				  timeout, wait, random_wait, delays);
+		for (i = 0; i < count; ++i)
+			stop_forwarder(&fw[i]);
+		if (!n)
+			break;
+		print_route_step("fanout", count, n, delays, verbose);
+		fit_add(&fit, count, median_ms(delays, n));
+		++steps;
+		if (count == fanout_max)
+			break;
+	}
+	print_route_fit("subscriber", &fit, verbose);
+
+	free(delays);
+	free(fw);
+	return steps ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static unsigned long long timespec_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+/*
+ * probes at a low rate until interrupted, and publishes the results as
+ * Prometheus metrics: rewritten to textfile every DAEMON_PUBLISH_MS, and
+ * served to every client of the Unix domain socket.  Lost probes are
+ * counted instead of ending the run.  hist and hm, if any, get every
+ * result too.
+ */
+static int run_daemon(struct link *l, double rate_hz, unsigned int timeout,
+		      const char *textfile, const char *socket_path,
+		      struct histogram *hist, struct heatmap *hm, int verbose)
+{
+	unsigned char msg[3] = { 0x90, 60, 127 };
+	unsigned long long interval_ns = 1000000000.0 / rate_hz;
+	unsigned long long next_ns, now_ns, published_ns = 0;
+	struct timespec begin, end, now;
+	struct monitor *m;
+	struct probe probe;
+	struct pollfd pfd;
+	int listen_fd = -1, err;
+
+	m = monitor_new(DAEMON_WINDOW);
+	check_mem(m);
+	if (socket_path) {
+		listen_fd = monitor_listen(socket_path);
+		if (listen_fd < 0)
+			fatal("cannot listen on %s: %s", socket_path, strerror(errno));
+	}
+	if (verbose)
+		printf("\n> probing at %g Hz until interrupted\n", rate_hz);
+
+	set_probe(l, &probe, msg, sizeof(msg));
+	clock_gettime(HR_CLOCK, &now);
+	next_ns = timespec_ns(&now);
+	while (!signal_received) {
+		/* serve clients while waiting for the next probe */
+		for (;;) {
+			clock_gettime(HR_CLOCK, &now);
+			now_ns = timespec_ns(&now);
+			if (now_ns >= next_ns)
+				break;
+			pfd.fd = listen_fd;
+			pfd.events = POLLIN;
+			err = poll(&pfd, listen_fd >= 0, (next_ns - now_ns + 999999) / 1000000);
+			if (signal_received)
+				break;
+			if (err > 0)
+				monitor_serve(m, listen_fd);
+		}
+		if (signal_received)
+			break;
+
+		err = probe_roundtrip(l, &probe, timeout, &begin, &end);
+		if (!err)
+			break;
+		if (err < 0) {
+			/* a late reply will not match the next probe */
+			monitor_lost(m);
+			if (hist)
+				histogram_lost(hist);
+			if (hm)
+				heatmap_lost(hm, timespec_ns(&begin));
+			midi_parser_reset(&l->parser);
+			ump_parser_reset(&l->ump_parser);
+			clock_gettime(HR_CLOCK, &end);
+		} else {
+			monitor_add(m, timespec_sub_ns(&end, &begin));
+			if (hist)
+				histogram_add(hist, timespec_sub_ns(&end, &begin));
+			if (hm)
+				heatmap_add(hm, timespec_ns(&begin), timespec_sub_ns(&end, &begin));
+		}
+		msg[0] ^= 1; // prevent running status
+		set_probe(l, &probe, msg, sizeof(msg));
+
+		now_ns = timespec_ns(&end);
+		if (textfile && now_ns - published_ns >= DAEMON_PUBLISH_MS * 1000000ULL) {
+			if (monitor_write_textfile(m, textfile))
+				fprintf(stderr, "cannot write %s: %s\n", textfile, strerror(errno));
+			published_ns = now_ns;
+		}
+		/* after a stall, go on at the normal rate instead of catching up */
+		next_ns += interval_ns;
+		if (next_ns < now_ns)
+			next_ns = now_ns;
+	}
+
+	if (textfile && monitor_write_textfile(m, textfile))
+		fprintf(stderr, "cannot write %s: %s\n", textfile, strerror(errno));
+	if (listen_fd >= 0) {
+		close(listen_fd);
+		unlink(socket_path);
+	}
+	if (verbose)
+		monitor_write(m, stdout);
+	monitor_free(m);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * waits until HR_CLOCK reaches target_ns: sleeps most of the way, and
+ * spins for the last PHASE_SPIN_NS, as sleeps wake up too late to hit a
+ * point within a USB frame
+ */
+static void wait_until_ns(unsigned long long target_ns)
+{
+	struct timespec now, rest;
+	unsigned long long now_ns;
+
+	clock_gettime(HR_CLOCK, &now);
+	now_ns = timespec_ns(&now);
+	if (target_ns > now_ns + PHASE_SPIN_NS) {
+		rest.tv_sec = (target_ns - now_ns - PHASE_SPIN_NS) / 1000000000;
+		rest.tv_nsec = (target_ns - now_ns - PHASE_SPIN_NS) % 1000000000;
+		nanosleep(&rest, NULL);
+	}
+	do
+		clock_gettime(HR_CLOCK, &now);
+	while (timespec_ns(&now) < target_ns && !signal_received);
+}
+
+/*
+ * sends probes at steps evenly spaced phases within period_ns, taking
+ * turns so that slow drift affects all phases alike, and reports the
+ * latency by the phase at which each probe actually went out
+ */
+static int run_phase_sweep(struct link *l, unsigned long long period_ns,
+			   int steps, int nr_samples, unsigned int timeout,
+			   int verbose)
+{
+	unsigned char msg[3] = { 0x90, 60, 127 };
+	unsigned long long now_ns, target_ns, *phases, *delays, *bin;
+	struct timespec begin, end;
+	struct probe probe;
+	int i, n, step, total = nr_samples * steps, taken = 0;
+	int best = -1, worst = -1;
+	double median, best_median = 0, worst_median = 0;
+
+	phases = calloc(total, sizeof(*phases));
+	delays = calloc(total, sizeof(*delays));
+	bin = calloc(total, sizeof(*bin));
+	check_mem(phases);
+	check_mem(delays);
+	check_mem(bin);
+
+	set_probe(l, &probe, msg, sizeof(msg));
+	for (i = 0; i < total && !signal_received; ++i) {
+		step = i % steps;
+		clock_gettime(HR_CLOCK, &end);
+		now_ns = timespec_ns(&end) + PHASE_IDLE_NS;
+		target_ns = now_ns - now_ns % period_ns + step * period_ns / steps;
+		if (target_ns < now_ns)
+			target_ns += period_ns;
+		wait_until_ns(target_ns);
+		if (!measure_probe(l, &probe, timeout, &begin, &end))
+			break;
+		phases[taken] = timespec_ns(&begin) % period_ns;
+		delays[taken++] = timespec_sub_ns(&end, &begin);
+		msg[0] ^= 1; // prevent running status
+		set_probe(l, &probe, msg, sizeof(msg));
+	}
+
+	if (verbose) {
+		printf("\n> latency by send phase within a %.1f us period:\n\n",
+		       period_ns / 1000.0);
+		printf("  phase_us  samples     min_ms  median_ms     max_ms\n");
+	}
+	for (step = 0; step < steps; ++step) {
+		for (i = n = 0; i < taken; ++i)
+			if (phases[i] * steps / period_ns == (unsigned long long)step)
+				bin[n++] = delays[i];
+		if (!n)
+			continue;
+		qsort(bin, n, sizeof(*bin), compare_ull);
+		median = median_ms(bin, n);
+		if (best < 0 || median < best_median) {
+			best = step;
+			best_median = median;
+		}
+		if (worst < 0 || median > worst_median) {
+			worst = step;
+			worst_median = median;
+		}
+		if (verbose)
+			printf("%10.1f %8d %10.3f %10.3f %10.3f\n",
+			       step * period_ns / steps / 1000.0, n,
+			       bin[0] / 1000000.0, median, bin[n - 1] / 1000000.0);
+		else
+			printf("%.1f, %d, %.3f, %.3f, %.3f\n",
+			       step * period_ns / steps / 1000.0, n,
+			       bin[0] / 1000000.0, median, bin[n - 1] / 1000000.0);
+	}
+	if (best >= 0 && verbose) {
+		printf("\n best  phase is %.1f us (median %.3f ms)\n",
+		       best * period_ns / steps / 1000.0, best_median);
+		printf(" worst phase is %.1f us (median %.3f ms), %.3f ms apart\n",
+		       worst * period_ns / steps / 1000.0, worst_median,
+		       worst_median - best_median);
+	}
+
+	free(bin);
+	free(delays);
+	free(phases);
+	return taken ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --burst: note ons sent together, one per channel and chord note */
+struct burst {
+	int channels;
+	int notes;
+	int elements;		/* channels * notes */
+	unsigned char *msgs;	/* 3 bytes per element, in send order */
+	unsigned char velocity;	/* counts bursts 1..127, tells late replies */
+	unsigned long long *arrival;	/* ns after the first write, 0: not yet */
+	int arrived;
+	int order;		/* arrival rank of the last element to arrive */
+	int out_of_order;
+};
+
+static void burst_fill(struct burst *b, unsigned char velocity)
+{
+	int e;
+
+	b->velocity = velocity;
+	for (e = 0; e < b->elements; ++e) {
+		b->msgs[e * 3] = 0x90 | (e / b->notes);
+		b->msgs[e * 3 + 1] = 60 + e % b->notes;
+		b->msgs[e * 3 + 2] = velocity;
+	}
+	memset(b->arrival, 0, b->elements * sizeof(*b->arrival));
+	b->arrived = 0;
+	b->order = -1;
+	b->out_of_order = 0;
+}
+
+/*
+ * writes the whole burst: with single_write in one write(), or through
+ * the sequencer's output buffer in one drain; otherwise message by
+ * message as fast as possible
+ */
+static void burst_send(struct link *l, const struct burst *b, int single_write)
+{
+	struct probe probe;
+	int e, err;
+
+	pthread_mutex_lock(&l->write_lock);
+	if (single_write && l->type != LINK_SEQ) {
+		set_probe(l, &probe, b->msgs, b->elements * 3);
+		write_part(l, &probe, b->msgs, b->elements * 3);
+	} else {
+		for (e = 0; e < b->elements; ++e) {
+			set_probe(l, &probe, b->msgs + e * 3, 3);
+			if (l->type == LINK_SEQ && single_write) {
+				err = snd_seq_event_output(seq, &probe.ev);
+				check_snd("output MIDI event", err);
+			} else {
+				write_part(l, &probe, probe.msg, 3);
+			}
+		}
+		if (l->type == LINK_SEQ && single_write) {
+			err = snd_seq_drain_output(seq);
+			check_snd("drain output", err);
+		}
+	}
+	pthread_mutex_unlock(&l->write_lock);
+}
+
+static void burst_receive(struct link *l, struct burst *b, long len,
+			  unsigned long long at_ns)
+{
+	struct midi_message m;
+	int e, ch, note;
+	long i;
+
+	for (i = 0; i < len; ++i) {
+		if (!midi_parser_feed(&l->parser, l->rec_buf[i], &m))
+			continue;
+		if ((m.status & 0xf0) != 0x90 || m.data[1] != b->velocity)
+			continue;
+		ch = m.status & 0x0f;
+		note = m.data[0] - 60;
+		if (ch >= b->channels || note < 0 || note >= b->notes)
+			continue;
+		e = ch * b->notes + note;
+		if (b->arrival[e])
+			continue;
+		b->arrival[e] = at_ns ? at_ns : 1;
+		b->arrived++;
+		if (e < b->order)
+			b->out_of_order = 1;
+		else
+			b->order = e;
+	}
+}
+
+static void print_burst_stats(const char *name, unsigned long long *values,
+			      int n)
+{
+	if (!n) {
+		printf("  %-18s no samples\n", name);
+		return;
+	}
+	qsort(values, n, sizeof(*values), compare_ull);
+	printf("  %-18s %8d %10.3f %10.3f %10.3f\n", name, n,
+	       values[0] / 1000000.0, median_ms(values, n),
+	       values[n - 1] / 1000000.0);
+}
+
+/*
+ * sends nr_samples bursts of a note on per channel and chord note, and
+ * reports each note's latency, the spread between the first and the last
+ * arrival, when the last note arrived, and whether arrival order matched
+ * send order.  Notes missing after the timeout are counted as lost; a
+ * burst of which nothing arrived adds to the losses only.  Fails if
+ * nothing arrived at all.
+ */
+static int run_burst(struct link *l, int channels, int notes,
+		     int single_write, int nr_samples, unsigned int timeout,
+		     double wait, int random_wait, int verbose)
+{
+	struct burst b = { .channels = channels, .notes = notes };
+	unsigned long long *latency, *spread, *last, first_ns, last_ns;
+	unsigned long long *values;
+	struct timespec begin, now;
+	unsigned short revents;
+	int i, e, n, sent = 0, bursts = 0, out_of_order = 0, lost = 0;
+	long err;
+	char name[40];
+
+	b.elements = channels * notes;
+	b.msgs = malloc(b.elements * 3);
+	b.arrival = calloc(b.elements, sizeof(*b.arrival));
+	latency = calloc((size_t)nr_samples * b.elements, sizeof(*latency));
+	spread = calloc(nr_samples, sizeof(*spread));
+	last = calloc(nr_samples, sizeof(*last));
+	values = calloc(nr_samples > b.elements ? nr_samples : b.elements,
+			sizeof(*values));
+	check_mem(b.msgs);
+	check_mem(b.arrival);
+	check_mem(latency);
+	check_mem(spread);
+	check_mem(last);
+	check_mem(values);
+
+	if (verbose)
+		printf("\n> bursts of %d channel%s x %d note%s, %s\n",
+		       channels, channels > 1 ? "s" : "", notes, notes > 1 ? "s" : "",
+		       single_write ? "in one write" : "written back-to-back");
+
+	for (i = 0; i < nr_samples && !signal_received; ++i) {
+		if (wait) {
+			if (random_wait)
+				wait_ms(wait + rand() * wait / RAND_MAX);
+			else
+				wait_ms(wait);
+		}
+		burst_fill(&b, 1 + i % 127);
+		clock_gettime(HR_CLOCK, &begin);
+		burst_send(l, &b, single_write);
+		while (b.arrived < b.elements && !signal_received) {
+			err = poll(l->pollfds, l->pollfds_count, timeout);
+			if (signal_received || err == 0)
+				break;
+			if (err < 0)
+				fatal("poll error: %s", strerror(errno));
+			clock_gettime(HR_CLOCK, &now);
+			revents = link_revents(l, l->pollfds);
+			if (revents & (POLLERR | POLLNVAL))
+				fatal("input went away");
+			if (!(revents & POLLIN))
+				continue;
+			err = read_input(l);
+			burst_receive(l, &b, err, timespec_sub_ns(&now, &begin));
+		}
+		if (signal_received)
+			break;
+		sent++;
+		if (b.arrived < b.elements) {
+			lost += b.elements - b.arrived;
+			midi_parser_reset(&l->parser);
+		}
+		if (!b.arrived)
+			continue;
+		first_ns = ULLONG_MAX;
+		last_ns = 0;
+		for (e = 0; e < b.elements; ++e) {
+			latency[(size_t)e * nr_samples + bursts] = b.arrival[e];
+			if (!b.arrival[e])
+				continue;
+			if (b.arrival[e] < first_ns)
+				first_ns = b.arrival[e];
+			if (b.arrival[e] > last_ns)
+				last_ns = b.arrival[e];
+		}
+		spread[bursts] = last_ns - first_ns;
+		last[bursts] = last_ns;
+		out_of_order += b.out_of_order;
+		bursts++;
+	}
+
+	if (verbose) {
+		printf("\n                      samples     min_ms  median_ms     max_ms\n");
+		for (e = 0; e < b.elements; ++e) {
+			for (i = n = 0; i < bursts; ++i)
+				if (latency[(size_t)e * nr_samples + i])
+					values[n++] = latency[(size_t)e * nr_samples + i];
+			snprintf(name, sizeof(name), "channel %2d note %d",
+				 e / notes + 1, 60 + e % notes);
+			print_burst_stats(name, values, n);
+		}
+		print_burst_stats("arrival spread", spread, bursts);
+		print_burst_stats("last note", last, bursts);
+		printf("\n %d of %d bursts arrived out of order", out_of_order, bursts);
+		printf(", %d of %d notes lost\n", lost, sent * b.elements);
+	} else {
+		qsort(spread, bursts, sizeof(*spread), compare_ull);
+		qsort(last, bursts, sizeof(*last), compare_ull);
+		if (bursts)
+			printf("%d, %d, %d, %d, %.3f, %.3f, %.3f, %.3f, %d, %d\n",
+			       channels, notes, sent, bursts,
+			       median_ms(spread, bursts), spread[bursts - 1] / 1000000.0,
+			       median_ms(last, bursts), last[bursts - 1] / 1000000.0,
+			       out_of_order, lost);
+	}
+
+	free(values);
+	free(last);
+	free(spread);
+	free(latency);
+	free(b.arrival);
+	free(b.msgs);
+	return bursts ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* long options without a short equivalent */
+enum {
+	OPT_SYSEX_SWEEP = 256,
+	OPT_CLOCK,
+	OPT_ACTIVE_SENSING,
+	OPT_CC_STREAM,
+	OPT_SYSEX_TRAFFIC,
+	OPT_SEQ_CHAIN,
+	OPT_SEQ_FANOUT,
+	OPT_FORENSICS,
+	OPT_TRACE_MARKER,
+	OPT_TRACE_JSON,
+	OPT_SAVE,
+	OPT_COMPARE,
+	OPT_MAX_REGRESSION,
+	OPT_MAX_LATENCY,
+	OPT_CI_WIDTH,
+	OPT_CI_PERCENTILES,
+	OPT_MAX_TIME,
+	OPT_DAEMON,
+	OPT_TEXTFILE,
+	OPT_SOCKET,
+	OPT_DUPLEX,
+	OPT_OUTPUT2,
+	OPT_INPUT2,
+	OPT_PHASE_SWEEP,
+	OPT_BURST,
+	OPT_BURST_WRITE,
+	OPT_UMP,
+	OPT_UMP_JR,
+	OPT_POLICY,
+	OPT_NICE,
+	OPT_DL_RUNTIME,
+	OPT_SCHED_COMPARE,
+	OPT_SUMMARY,
+	OPT_MERGE,
+	OPT_HEATMAP,
+	OPT_HEATMAP_SVG,
+	OPT_PROBE_TYPES,
+};
+
+int compare_unsigned_int(const void *p1, const void *p2)
+{
+	unsigned int a = *(const unsigned int *)p1;
+	unsigned int b = *(const unsigned int *)p2;
+
+	/* a - b would overflow for values more than 2^31 ns apart */
+	return (a > b) - (a < b);
+}
+
+/* nearest rank p-th percentile of n sorted values */
+static unsigned int percentile(const unsigned int *sorted, unsigned int n,
+			       double p)
+{
+	unsigned int rank = p / 100.0 * n + 0.5;
+
+	if (rank < 1)
+		rank = 1;
+	if (rank > n)
+		rank = n;
+	return sorted[rank - 1];
+}
+
+/*
+ * MSER-5 warm-up detection: the truncation point, in whole batches of
+ * MSER_BATCH samples, that minimizes the standard error of the mean of
+ * the remaining batch means.  Only the first half is considered; later
+ * minima are artifacts of the few batches left.
+ */
+static unsigned int mser_truncation(const unsigned int *delays, unsigned int n)
+{
+	unsigned int batches = n / MSER_BATCH, i, d, best = 0;
+	double *b, center = 0, sum = 0, sum2 = 0, k, value, best_value = -1;
+
+	if (batches < 4)
+		return 0;
+	b = malloc(batches * sizeof(*b));
+	check_mem(b);
+	for (i = 0; i < batches * MSER_BATCH; ++i)
+		center += delays[i];
+	center /= batches * MSER_BATCH;
+	for (d = 0; d < batches; ++d) {
+		b[d] = 0;
+		for (i = 0; i < MSER_BATCH; ++i)
+			b[d] += delays[d * MSER_BATCH + i];
+		/* centered, so the sums of squares keep their precision */
+		b[d] = b[d] / MSER_BATCH - center;
+	}
+	for (d = batches; d-- > 0; ) {
+		sum += b[d];
+		sum2 += b[d] * b[d];
+		if (d > batches / 2)
+			continue;
+		k = batches - d;
+		value = (sum2 - sum * sum / k) / (k * k);
+		if (best_value < 0 || value <= best_value) {
+			best_value = value;
+			best = d;
+		}
+	}
+	free(b);
+	return best * MSER_BATCH;
+}
+
+static void print_delay_stats(const char *name, const unsigned int *delays,
+			      unsigned int n)
+{
+	unsigned int i, min = UINT_MAX, max = 0;
+	double total = 0;
+
+	for (i = 0; i < n; ++i) {
+		if (delays[i] < min)
+			min = delays[i];
+		if (delays[i] > max)
+			max = delays[i];
+		total += delays[i];
+	}
+	if (n)
+		printf("  %-8s %8u %10.3f %10.3f %10.3f\n", name, n,
+		       min / 1000000.0, total / n / 1000000.0, max / 1000000.0);
+	else
+		printf("  %-8s %8u\n", name, n);
+}
+
+/* the percentiles whose confidence interval decides when to stop */
+struct ci_target {
+	double points[CI_MAX_PERCENTILES];
+	int nr_points;
+	double width;		/* relative, in percent */
+	unsigned int *sorted;
+};
+
+static void parse_percentiles(struct ci_target *t, const char *list)
+{
+	char *end;
+	double p;
+
+	t->nr_points = 0;
+	for (;;) {
+		p = strtod(list, &end);
+		if (end == list || p <= 0 || p >= 100)
+			fatal("invalid percentile list: %s", list);
+		if (t->nr_points == CI_MAX_PERCENTILES)
+			fatal("at most %d percentiles", CI_MAX_PERCENTILES);
+		t->points[t->nr_points++] = p;
+		if (*end != ',')
+			break;
+		list = end + 1;
+	}
+	if (*end)
+		fatal("invalid percentile list: %s", list);
+}
+
+/*
+ * whether every percentile's 95% confidence interval is narrower than
+ * width percent of it; a percentile needs a few samples beyond it first
+ */
+static int ci_reached(struct ci_target *t, const unsigned int *delays,
+		      unsigned int n)
+{
+	unsigned int value, lo, hi;
+	double q;
+	int i;
+
+	memcpy(t->sorted, delays, n * sizeof(*delays));
+	qsort(t->sorted, n, sizeof(*delays), compare_unsigned_int);
+	for (i = 0; i < t->nr_points; ++i) {
+		q = t->points[i] / 100;
+		if (n * (1 - q) < 5)
+			return 0;
+		quantile_ci(t->sorted, n, q, &value, &lo, &hi);
+		if (hi - lo > value * t->width / 100)
+			return 0;
+	}
+	return 1;
+}
+
+static void print_ci_report(struct ci_target *t, const unsigned int *delays,
+			    unsigned int n, int reached)
+{
+	unsigned int value, lo, hi;
+	int i;
+
+	memcpy(t->sorted, delays, n * sizeof(*delays));
+	qsort(t->sorted, n, sizeof(*delays), compare_unsigned_int);
+	if (reached)
+		printf("\n> confidence intervals narrower than %g%% after %u samples:\n",
+		       t->width, n);
+	else
+		printf("\n> confidence intervals not narrower than %g%% after %u samples:\n",
+		       t->width, n);
+	printf("  percentile    value_ms       95%% CI_ms       width\n");
+	for (i = 0; i < t->nr_points; ++i) {
+		quantile_ci(t->sorted, n, t->points[i] / 100, &value, &lo, &hi);
+		printf("  %10g %11.3f  [%.3f, %.3f] %9.1f%%\n", t->points[i],
+		       value / 1000000.0, lo / 1000000.0, hi / 1000000.0,
+		       value ? (hi - lo) * 100.0 / value : 0.0);
+	}
+}
+
+/* compares the samples taken while background traffic was on and off */
+static void print_traffic_report(const struct traffic *t,
+				 const unsigned int *delays,
+				 const unsigned char *loaded,
+				 unsigned int first, unsigned int nr,
+				 int precision)
+{
+	unsigned int *sorted[2], n[2] = { 0, 0 };
+	unsigned int i, k;
+	static const char *const label[2] = { "quiet", "loaded" };
+
+	for (k = 0; k < 2; ++k) {
+		sorted[k] = malloc((nr + 1) * sizeof(*sorted[k]));
+		check_mem(sorted[k]);
+	}
+	for (i = first; i < nr; ++i) {
+		k = !!loaded[i];
+		sorted[k][n[k]++] = delays[i];
+	}
+
+	printf("\n> background traffic:\n\n");
+	for (i = 0; i < (unsigned int)t->nr_sources; ++i)
+		printf(" %-14s %8.2f msgs/s, %6zu bytes each, %lu sent\n",
+		       t->sources[i].name, 1e9 / t->sources[i].period_ns,
+		       t->sources[i].len, t->sources[i].sent);
+	printf(" %llu bytes in total, in alternating blocks of %d samples\n\n",
+	       t->bytes_sent, TRAFFIC_BLOCK);
+
+	printf("          samples %*s %*s %*s %*s\n",
+	       9 + precision, "min_ms", 9 + precision, "median_ms",
+	       9 + precision, "p99_ms", 9 + precision, "max_ms");
+	for (k = 0; k < 2; ++k) {
+		if (!n[k])
+			continue;
+		qsort(sorted[k], n[k], sizeof(sorted[k][0]), compare_unsigned_int);
+		printf(" %-8s %8u %*.*f %*.*f %*.*f %*.*f\n", label[k], n[k],
+		       9 + precision, 2 + precision, sorted[k][0] / 1000000.0,
+		       9 + precision, 2 + precision, percentile(sorted[k], n[k], 50) / 1000000.0,
+		       9 + precision, 2 + precision, percentile(sorted[k], n[k], 99) / 1000000.0,
+		       9 + precision, 2 + precision, sorted[k][n[k] - 1] / 1000000.0);
+	}
+	if (n[0] && n[1])
+		printf("\n median is %+.*f ms and worst case %+.*f ms with traffic\n",
+		       2 + precision,
+		       ((double)percentile(sorted[1], n[1], 50) - percentile(sorted[0], n[0], 50)) / 1000000.0,
+		       2 + precision,
+		       ((double)sorted[1][n[1] - 1] - sorted[0][n[0] - 1]) / 1000000.0);
+	free(sorted[0]);
+	free(sorted[1]);
+}
+
+/*
+ * --duplex: a sender and a receiver thread keep probes going both ways
+ * at once.  Each probe carries its sequence number in the channel, note
+ * and velocity.  The sender publishes the send time in a table slot
+ * before writing the probe, and the receiver claims the slot with a
+ * compare and swap, so neither thread ever waits for the other.  Slots
+ * are reused after DUPLEX_SLOTS probes; a reply that comes back later
+ * than that is counted as lost.
+ */
+#define DUPLEX_SLOTS 2048
+#define DUPLEX_IDS (16 * 128 * 127)	/* a multiple of DUPLEX_SLOTS */
+#define DUPLEX_FREE UINT_MAX
+
+struct duplex_slot {
+	unsigned int seq;
+	unsigned int sent_ns;		/* only differences matter */
+};
+
+struct duplex_link {
+	struct link *link;
+	struct duplex_slot slots[DUPLEX_SLOTS];
+	struct pollfd *pollfds;		/* this link's part of duplex.pollfds */
+	/* written by the sender */
+	unsigned int sent;
+	/* written by the receiver */
+	unsigned int received;
+	unsigned int reordered;
+	unsigned int unmatched;
+	unsigned int highest;
+	unsigned int *delays;
+};
+
+struct duplex {
+	struct duplex_link links[2];
+	int nr_links;
+	unsigned int count;
+	unsigned long long interval_ns;
+	struct pollfd *pollfds;
+	int pollfds_count;
+	volatile int stop;
+};
+
+static void duplex_msg(unsigned int seq, unsigned char *msg)
+{
+	unsigned int id = seq % DUPLEX_IDS;
+
+	msg[0] = 0x90 | (id & 0x0f);
+	msg[1] = (id >> 4) & 0x7f;
+	msg[2] = 1 + (id >> 11);	/* never 0, which would be a note off */
+}
+
+static void *duplex_sender(void *arg)
+{
+	struct duplex *d = arg;
+	struct duplex_link *dl;
+	struct duplex_slot *slot;
+	struct timespec next, now;
+	unsigned char msg[3];
+	struct probe probe;
+	unsigned int seq;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (seq = 0; seq < d->count && !d->stop && !signal_received; ++seq) {
+		for (i = 0; i < d->nr_links; ++i) {
+			dl = &d->links[i];
+			duplex_msg(seq, msg);
+			set_probe(dl->link, &probe, msg, sizeof(msg));
+			slot = &dl->slots[seq % DUPLEX_SLOTS];
+			/* a receiver still holding the old entry must fail its claim */
+			__atomic_store_n(&slot->seq, DUPLEX_FREE, __ATOMIC_SEQ_CST);
+			clock_gettime(HR_CLOCK, &now);
+			__atomic_store_n(&slot->sent_ns, (unsigned int)timespec_ns(&now), __ATOMIC_SEQ_CST);
+			__atomic_store_n(&slot->seq, seq, __ATOMIC_SEQ_CST);
+			pthread_mutex_lock(&dl->link->write_lock);
+			write_part(dl->link, &probe, msg, sizeof(msg));
+			pthread_mutex_unlock(&dl->link->write_lock);
+			dl->sent++;
+		}
+		next.tv_nsec += d->interval_ns;
+		while (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+	return NULL;
+}
+
+static void duplex_receive(struct duplex_link *dl, const unsigned char *buf,
+			   long len, unsigned int now_ns)
+{
+	struct duplex_slot *slot;
+	struct midi_message m;
+	unsigned int id, seq, sent_ns;
+	long i;
+
+	for (i = 0; i < len; ++i) {
+		if (!midi_parser_feed(&dl->link->parser, buf[i], &m))
+			continue;
+		if ((m.status & 0xf0) != 0x90 || !m.data[1])
+			continue;
+		id = (m.status & 0x0f) | m.data[0] << 4 | (m.data[1] - 1) << 11;
+		slot = &dl->slots[id % DUPLEX_SLOTS];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST);
+		sent_ns = __atomic_load_n(&slot->sent_ns, __ATOMIC_SEQ_CST);
+		if (seq == DUPLEX_FREE || seq % DUPLEX_IDS != id ||
+		    !__atomic_compare_exchange_n(&slot->seq, &seq, DUPLEX_FREE, 0,
+						 __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			dl->unmatched++;
+			continue;
+		}
+		if (dl->received && seq < dl->highest)
+			dl->reordered++;
+		else
+			dl->highest = seq;
+		dl->delays[dl->received++] = now_ns - sent_ns;
+	}
+}
+
+static struct duplex_link *duplex_find_port(struct duplex *d, int port)
+{
+	int i;
+
+	for (i = 0; i < d->nr_links; ++i)
+		if (d->links[i].link->port == port)
+			return &d->links[i];
+	return NULL;
+}
+
+static void *duplex_receiver(void *arg)
+{
+	struct duplex *d = arg;
+	struct duplex_link *dl;
+	snd_seq_event_t *ev;
+	struct timespec now;
+	unsigned short revents;
+	long n;
+	int i, err;
+
+	while (!d->stop) {
+		err = poll(d->pollfds, d->pollfds_count, 100);
+		if (err <= 0)
+			continue;
+		clock_gettime(HR_CLOCK, &now);
+		for (i = 0; i < d->nr_links; ++i) {
+			dl = &d->links[i];
+			revents = link_revents(dl->link, dl->pollfds);
+			if (!(revents & POLLIN))
+				continue;
+			if (dl->link->type != LINK_SEQ) {
+				n = read_input(dl->link);
+				duplex_receive(dl, dl->link->rec_buf, n, timespec_ns(&now));
+				continue;
+			}
+			/* sequencer links share the client's input */
+			do {
+				if (snd_seq_event_input(seq, &ev) < 0)
+					break;
+				dl = duplex_find_port(d, ev->dest.port);
+				if (!dl)
+					continue;
+				n = snd_midi_event_decode(dl->link->decoder, dl->link->rec_buf,
+							  sizeof(dl->link->rec_buf), ev);
+				if (n > 0)
+					duplex_receive(dl, dl->link->rec_buf, n, timespec_ns(&now));
+			} while (snd_seq_event_input_pending(seq, 0) > 0);
+			break;
+		}
+	}
+	return NULL;
+}
+
+static void print_duplex_link(const struct duplex_link *dl, int nr,
+			      int verbose)
+{
+	unsigned int n = dl->received;
+
+	if (!verbose) {
+		/* the port names may contain commas; number the links */
+		printf("%d, %u, %u, %u, %u, %u", nr, dl->sent, n, dl->sent - n,
+		       dl->reordered, dl->unmatched);
+		if (n) {
+			qsort(dl->delays, n, sizeof(*dl->delays), compare_unsigned_int);
+			printf(", %.3f, %.3f, %.3f, %.3f", dl->delays[0] / 1000000.0,
+			       percentile(dl->delays, n, 50) / 1000000.0,
+			       percentile(dl->delays, n, 99) / 1000000.0,
+			       dl->delays[n - 1] / 1000000.0);
+		}
+		printf("\n");
+		return;
+	}
+	printf("\n  %s -> %s:\n", dl->link->output_name, dl->link->input_name);
+	printf("    sent %u, received %u, lost %u, reordered %u, unmatched %u\n",
+	       dl->sent, n, dl->sent - n, dl->reordered, dl->unmatched);
+	if (!n)
+		return;
+	qsort(dl->delays, n, sizeof(*dl->delays), compare_unsigned_int);
+	printf("    latency min %.3f, median %.3f, 99%% %.3f, max %.3f ms\n",
+	       dl->delays[0] / 1000000.0, percentile(dl->delays, n, 50) / 1000000.0,
+	       percentile(dl->delays, n, 99) / 1000000.0,
+	       dl->delays[n - 1] / 1000000.0);
+}
+
+/*
+ * sends count probes on each link at rate_hz from one thread, while
+ * another receives them; with a second loopback cable, both directions
+ * of the interface carry traffic at the same time.  Fails if a link
+ * received nothing.
+ */
+static int run_duplex(struct link *l1, struct link *l2, unsigned int count,
+		      double rate_hz, unsigned int timeout, int verbose)
+{
+	struct link *links[2] = { l1, l2 };
+	struct duplex *d;
+	pthread_t sender, receiver;
+	int i, j, err, silent = 0;
+
+	d = calloc(1, sizeof(*d));
+	check_mem(d);
+	d->nr_links = l2 ? 2 : 1;
+	d->count = count;
+	d->interval_ns = 1000000000.0 / rate_hz;
+	d->pollfds = calloc(l1->pollfds_count + (l2 ? l2->pollfds_count : 0),
+			    sizeof(*d->pollfds));
+	check_mem(d->pollfds);
+	for (i = 0; i < d->nr_links; ++i) {
+		d->links[i].link = links[i];
+		d->links[i].delays = calloc(count, sizeof(*d->links[i].delays));
+		check_mem(d->links[i].delays);
+		for (j = 0; j < DUPLEX_SLOTS; ++j)
+			d->links[i].slots[j].seq = DUPLEX_FREE;
+		d->links[i].pollfds = d->pollfds + d->pollfds_count;
+		/* sequencer links share the client's descriptors */
+		if (links[i]->type == LINK_SEQ && i > 0) {
+			d->links[i].pollfds = d->links[0].pollfds;
+			continue;
+		}
+		memcpy(d->links[i].pollfds, links[i]->pollfds,
+		       links[i]->pollfds_count * sizeof(*d->pollfds));
+		d->pollfds_count += links[i]->pollfds_count;
+	}
+
+	if (verbose)
+		printf("\n> duplex: %u probes per link at %g Hz, sent and received by separate threads\n",
+		       count, rate_hz);
+	err = pthread_create(&receiver, NULL, duplex_receiver, d);
+	check_posix("create receiver thread", err);
+	err = pthread_create(&sender, NULL, duplex_sender, d);
+	check_posix("create sender thread", err);
+	pthread_join(sender, NULL);
+	/* give the last probes time to come back */
+	wait_ms(timeout);
+	d->stop = 1;
+	pthread_join(receiver, NULL);
+
+	if (verbose)
+		printf("\n> duplex results:\n");
+	for (i = 0; i < d->nr_links; ++i) {
+		print_duplex_link(&d->links[i], i + 1, verbose);
+		if (!d->links[i].received)
+			silent = 1;
+		free(d->links[i].delays);
+	}
+	free(d->pollfds);
+	free(d);
+	return silent ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void print_ump_compare_row(const char *name, unsigned int *delays,
+				  unsigned int n, unsigned int lost, int verbose)
+{
+	qsort(delays, n, sizeof(*delays), compare_unsigned_int);
+	if (verbose)
+		printf("  %-10s %9.3f %9.3f %9.3f %9.3f %6u\n", name,
+		       delays[0] / 1000000.0, percentile(delays, n, 50) / 1000000.0,
+		       percentile(delays, n, 99) / 1000000.0,
+		       delays[n - 1] / 1000000.0, lost);
+	else
+		printf("%s, %.3f, %.3f, %.3f, %.3f, %u\n", name,
+		       delays[0] / 1000000.0, percentile(delays, n, 50) / 1000000.0,
+		       percentile(delays, n, 99) / 1000000.0,
+		       delays[n - 1] / 1000000.0, lost);
+}
+
+/*
+ * --ump with --output2/--input2: alternates the same note on between the
+ * UMP endpoint and the MIDI 1.0 ports of the same device, so that both
+ * protocols see the same conditions; the order swaps on every other
+ * sample to cancel out any effect of going first
+ */
+static int run_ump_compare(struct link *ump, struct link *midi1, unsigned int nr,
+			   unsigned int timeout, double wait, int random_wait,
+			   int verbose)
+{
+	unsigned char msg[] = { 0x90, 0x3c, 0x40 };
+	struct link *links[2] = { ump, midi1 };
+	unsigned int *delays[2];
+	unsigned int count[2] = { 0, 0 }, lost[2] = { 0, 0 };
+	struct timespec begin, end;
+	struct probe probe;
+	char name[16];
+	unsigned int i;
+	int j, k, err;
+	double z, p;
+
+	for (j = 0; j < 2; ++j) {
+		delays[j] = calloc(nr, sizeof(*delays[j]));
+		check_mem(delays[j]);
+	}
+	if (verbose)
+		printf("\n> alternating %u probes between UMP (%d bit) and MIDI 1.0\n",
+		       nr, ump->ump_bits);
+
+	for (i = 0; i < nr && !signal_received; ++i) {
+		for (k = 0; k < 2; ++k) {
+			j = k ^ (i & 1);
+			set_probe(links[j], &probe, msg, sizeof(msg));
+			err = probe_roundtrip(links[j], &probe, timeout, &begin, &end);
+			if (!err)
+				break;
+			if (err < 0) {
+				lost[j]++;
+				midi_parser_reset(&links[j]->parser);
+				ump_parser_reset(&links[j]->ump_parser);
+			} else {
+				delays[j][count[j]++] = timespec_sub_ns(&end, &begin);
+			}
+		}
+		msg[0] ^= 1; // prevent running status
+		if (wait)
+			wait_ms(random_wait ? wait + wait * rand() / RAND_MAX : wait);
+	}
+	if (!count[0] || !count[1])
+		fatal("no replies on the %s link", count[0] ? "MIDI 1.0" : "UMP");
+
+	snprintf(name, sizeof(name), "ump%d", ump->ump_bits);
+	if (verbose)
+		printf("\n  %-10s %9s %9s %9s %9s %6s\n", "ms", "min", "median",
+		       "99%", "max", "lost");
+	print_ump_compare_row(name, delays[0], count[0], lost[0], verbose);
+	print_ump_compare_row("midi1", delays[1], count[1], lost[1], verbose);
+	z = mann_whitney(delays[0], count[0], delays[1], count[1], &p);
+	if (verbose)
+		printf("\n> Mann-Whitney z = %.2f, p = %.3g: %s\n", z, p,
+		       p >= COMPARE_ALPHA ? "no significant difference" :
+		       z > 0 ? "UMP is slower" : "UMP is faster");
+	for (j = 0; j < 2; ++j)
+		free(delays[j]);
+	return EXIT_SUCCESS;
+}
+
+/* --sched-compare: one policy's share of the probes */
+struct sched_run {
+	struct sched_setting setting;
+	unsigned int *delays;
+	unsigned int taken;
+	unsigned int lost;
+	unsigned int missed;
+	int failed;
+};
+
+/*
+ * probes once per period until count samples are taken.  Other policies
+ * sleep until the next period; under SCHED_DEADLINE, sched_yield() ends
+ * the job and the scheduler starts the next one.  Either way, a probe that
+ * starts more than half a period late has missed periods.
+ */
+static int sched_block(struct link *l, struct sched_run *r, unsigned int count,
+		       unsigned long long period_ns, unsigned int timeout)
+{
+	unsigned char msg[3] = { 0x90, 60, 127 };
+	unsigned long long start_ns, prev_ns = 0, next_ns;
+	struct timespec begin, end, ts, now;
+	struct probe probe;
+	unsigned int i;
+	int err;
+
+	/* CLOCK_MONOTONIC, the clock that clock_nanosleep() waits on */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	next_ns = timespec_ns(&now);
+	for (i = 0; i < count && !signal_received; ++i) {
+		if (r->setting.policy == SCHED_DEADLINE) {
+			sched_yield();
+		} else {
+			ts.tv_sec = next_ns / 1000000000;
+			ts.tv_nsec = next_ns % 1000000000;
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		start_ns = timespec_ns(&now);
+		if (prev_ns && start_ns - prev_ns > period_ns + period_ns / 2)
+			r->missed += (start_ns - prev_ns + period_ns / 2) / period_ns - 1;
+		prev_ns = start_ns;
+
+		msg[0] ^= 1; // prevent running status
+		set_probe(l, &probe, msg, sizeof(msg));
+		err = probe_roundtrip(l, &probe, timeout, &begin, &end);
+		if (!err)
+			return 0;
+		if (err < 0) {
+			r->lost++;
+			midi_parser_reset(&l->parser);
+			ump_parser_reset(&l->ump_parser);
+		} else {
+			r->delays[r->taken++] = timespec_sub_ns(&end, &begin);
+		}
+
+		/* skip the periods that are already over */
+		next_ns += period_ns;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		start_ns = timespec_ns(&now);
+		if (next_ns < start_ns)
+			next_ns += (start_ns - next_ns) / period_ns * period_ns + period_ns;
+	}
+	return 1;
+}
+
+/*
+ * runs the same probe schedule under SCHED_OTHER, SCHED_FIFO, SCHED_RR
+ * and SCHED_DEADLINE, in blocks of SCHED_BLOCK probes that take turns so
+ * that slow drift affects all policies alike
+ */
+static int run_sched_compare(struct link *l, double rate_hz, unsigned int nr,
+			     unsigned int timeout, int prio, int nice,
+			     unsigned long long runtime_ns, int verbose)
+{
+	unsigned long long period_ns = 1000000000.0 / rate_hz;
+	struct sched_run runs[4];
+	unsigned int done, n;
+	int i, active;
+
+	memset(runs, 0, sizeof(runs));
+	runs[0].setting.policy = SCHED_OTHER;
+	runs[1].setting.policy = SCHED_FIFO;
+	runs[2].setting.policy = SCHED_RR;
+	runs[3].setting.policy = SCHED_DEADLINE;
+	for (i = 0; i < 4; ++i) {
+		runs[i].setting.prio = prio;
+		runs[i].setting.nice = nice;
+		runs[i].setting.runtime_ns = runtime_ns ? runtime_ns : period_ns / 4;
+		runs[i].setting.period_ns = period_ns;
+		runs[i].delays = calloc(nr, sizeof(*runs[i].delays));
+		check_mem(runs[i].delays);
+	}
+	if (verbose)
+		printf("\n> probing at %g Hz under each policy, %u probes in blocks of %d\n",
+		       rate_hz, nr, SCHED_BLOCK);
+
+	for (done = 0; done < nr && !signal_received; done += n) {
+		n = nr - done < SCHED_BLOCK ? nr - done : SCHED_BLOCK;
+		for (i = active = 0; i < 4 && !signal_received; ++i) {
+			if (runs[i].failed)
+				continue;
+			if (set_realtime_priority(&runs[i].setting)) {
+				fprintf(stderr, "> skipping %s\n", policy_name(runs[i].setting.policy));
+				runs[i].failed = 1;
+				continue;
+			}
+			active++;
+			if (!sched_block(l, &runs[i], n, period_ns, timeout))
+				break;
+		}
+		if (!active)
+			fatal("cannot switch to any scheduling policy");
+	}
+
+	if (verbose)
+		printf("\n  %-15s %7s %9s %9s %9s %9s %6s %7s\n", "ms", "samples",
+		       "min", "median", "99%", "max", "lost", "missed");
+	for (i = 0; i < 4; ++i) {
+		struct sched_run *r = &runs[i];
+
+		if (!r->taken)
+			continue;
+		qsort(r->delays, r->taken, sizeof(*r->delays), compare_unsigned_int);
+		if (verbose)
+			printf("  %-15s %7u %9.3f %9.3f %9.3f %9.3f %6u %7u\n",
+			       policy_name(r->setting.policy), r->taken,
+			       r->delays[0] / 1000000.0,
+			       percentile(r->delays, r->taken, 50) / 1000000.0,
+			       percentile(r->delays, r->taken, 99) / 1000000.0,
+			       r->delays[r->taken - 1] / 1000000.0, r->lost, r->missed);
+		else
+			printf("%s, %u, %.3f, %.3f, %.3f, %.3f, %u, %u\n",
+			       policy_name(r->setting.policy), r->taken,
+			       r->delays[0] / 1000000.0,
+			       percentile(r->delays, r->taken, 50) / 1000000.0,
+			       percentile(r->delays, r->taken, 99) / 1000000.0,
+			       r->delays[r->taken - 1] / 1000000.0, r->lost, r->missed);
+	}
+	for (i = 0; i < 4; ++i)
+		free(runs[i].delays);
+	return EXIT_SUCCESS;
+}
+
+/* --probe-types: the messages that take turns as the probe */
+struct probe_type {
+	const char *name;
+	unsigned char msg[3];
+	size_t len;
+};
+
+static const struct probe_type probe_types[] = {
+	{ "clock", { 0xf8 }, 1 },
+	{ "start", { 0xfa }, 1 },
+	{ "program", { 0xc0, 0 }, 2 },
+	{ "cc", { 0xb0, 1, 0 }, 3 },
+	{ "bend", { 0xe0, 0, 0x40 }, 3 },
+	{ "noteon", { 0x90, 60, 127 }, 3 },
+};
+
+/* a comma separated list of probe type names, as a mask of probe_types */
+static unsigned int parse_probe_types(const char *list)
+{
+	unsigned int mask = 0, i;
+	size_t len;
+
+	while (*list) {
+		len = strcspn(list, ",");
+		for (i = 0; i < ARRAY_SIZE(probe_types); ++i)
+			if (strlen(probe_types[i].name) == len &&
+			    !strncmp(probe_types[i].name, list, len))
+				break;
+		if (i == ARRAY_SIZE(probe_types))
+			fatal("unknown probe type: %.*s", (int)len, list);
+		mask |= 1U << i;
+		list += len;
+		if (*list)
+			list++;
+	}
+	return mask;
+}
+
+/*
+ * varies the data bytes with the sample number, so that a late reply does
+ * not match the next probe, and toggles the channel against running
+ * status; realtime messages have nothing to vary
+ */
+static void probe_type_msg(const struct probe_type *t, unsigned int nr,
+			   unsigned char *msg)
+{
+	memcpy(msg, t->msg, t->len);
+	if (msg[0] >= 0xf0)
+		return;
+	msg[0] ^= nr & 1;
+	switch (msg[0] & 0xf0) {
+	case 0xc0:
+	case 0xe0:
+		msg[1] = nr & 0x7f;
+		break;
+	case 0xb0:
+		msg[2] = nr & 0x7f;
+		break;
+	case 0x90:
+		msg[2] = 1 + nr % 127;
+		break;
+	}
+}
+
+/*
+ * takes nr samples of each probe type in mask, round by round; every
+ * round starts with the next type, so that no type always goes first
+ */
+static int run_probe_types(struct link *l, unsigned int mask, unsigned int nr,
+			   unsigned int timeout, double wait, int random_wait,
+			   int verbose)
+{
+	const struct probe_type *types[ARRAY_SIZE(probe_types)];
+	unsigned int *delays[ARRAY_SIZE(probe_types)];
+	unsigned int taken[ARRAY_SIZE(probe_types)] = { 0 };
+	unsigned int lost[ARRAY_SIZE(probe_types)] = { 0 };
+	unsigned char msg[3];
+	struct timespec begin, end;
+	struct probe probe;
+	unsigned int i, n = 0, k, t, ref;
+	const char *verdict;
+	double z, p;
+	int err = 1;
+
+	for (i = 0; i < ARRAY_SIZE(probe_types); ++i) {
+		if (!(mask & (1U << i)))
+			continue;
+		types[n] = &probe_types[i];
+		delays[n] = calloc(nr, sizeof(*delays[n]));
+		check_mem(delays[n++]);
+	}
+	if (verbose)
+		printf("\n> %u probes each of %u message types, taking turns\n", nr, n);
+
+	for (i = 0; i < nr && err && !signal_received; ++i) {
+		for (k = 0; k < n; ++k) {
+			t = (i + k) % n;
+			if (wait)
+				wait_ms(random_wait ? wait + wait * rand() / RAND_MAX : wait);
+			probe_type_msg(types[t], i, msg);
+			set_probe(l, &probe, msg, types[t]->len);
+			err = probe_roundtrip(l, &probe, timeout, &begin, &end);
+			if (!err)
+				break;
+			if (err < 0) {
+				lost[t]++;
+				midi_parser_reset(&l->parser);
+				ump_parser_reset(&l->ump_parser);
+			} else {
+				delays[t][taken[t]++] = timespec_sub_ns(&end, &begin);
+			}
+		}
+	}
+
+	/* note on is what every other mode measures */
+	for (ref = 0; ref < n && strcmp(types[ref]->name, "noteon"); ++ref)
+		;
+	for (t = 0; t < n; ++t)
+		qsort(delays[t], taken[t], sizeof(*delays[t]), compare_unsigned_int);
+	if (verbose)
+		printf("\n  %-8s %5s %7s %9s %9s %9s %9s %6s\n", "ms", "bytes",
+		       "samples", "min", "median", "99%", "max", "lost");
+	for (t = 0; t < n; ++t) {
+		if (!taken[t]) {
+			if (verbose)
+				printf("  %-8s %5zu %7u %39s %6u\n", types[t]->name,
+				       types[t]->len, 0, "(no replies)", lost[t]);
+			else
+				printf("%s, %zu, 0, -, -, -, -, %u\n", types[t]->name,
+				       types[t]->len, lost[t]);
+			continue;
+		}
+		verdict = "";
+		if (ref < n && t != ref && taken[ref]) {
+			z = mann_whitney(delays[t], taken[t], delays[ref], taken[ref], &p);
+			if (p < COMPARE_ALPHA)
+				verdict = z > 0 ? "slower than noteon" : "faster than noteon";
+		}
+		if (verbose)
+			printf("  %-8s %5zu %7u %9.3f %9.3f %9.3f %9.3f %6u%s%s\n",
+			       types[t]->name, types[t]->len, taken[t],
+			       delays[t][0] / 1000000.0,
+			       percentile(delays[t], taken[t], 50) / 1000000.0,
+			       percentile(delays[t], taken[t], 99) / 1000000.0,
+			       delays[t][taken[t] - 1] / 1000000.0, lost[t],
+			       *verdict ? "  " : "", verdict);
+		else
+			printf("%s, %zu, %u, %.3f, %.3f, %.3f, %.3f, %u\n",
+			       types[t]->name, types[t]->len, taken[t],
+			       delays[t][0] / 1000000.0,
+			       percentile(delays[t], taken[t], 50) / 1000000.0,
+			       percentile(delays[t], taken[t], 99) / 1000000.0,
+			       delays[t][taken[t] - 1] / 1000000.0, lost[t]);
+	}
+	for (t = 0; t < n; ++t)
+		free(delays[t]);
+	return EXIT_SUCCESS;
+}
+
+/* the heatmap fills the terminal, less the latency labels */
+static unsigned int heatmap_width(void)
+{
+	const char *columns = getenv("COLUMNS");
+	int width = columns ? atoi(columns) : 80;
+
+	return width > 34 ? width - 14 : 20;
+}
+
+static void finish_heatmap(struct heatmap *hm, const char *svg_path,
+			   int print)
+{
+	if (print) {
+		printf("\n> latency over time:\n\n");
+		heatmap_print(hm, stdout, heatmap_width());
+	}
+	if (svg_path && heatmap_write_svg(hm, svg_path))
+		fatal("cannot write %s: %s", svg_path, strerror(errno));
+	heatmap_free(hm);
+}
+
+/*
+ * --merge: adds up summaries written with --summary, by any number of
+ * runs on any number of hosts, as long as they measured the same way
+ */
+static int run_merge(char **paths, int n, const char *summary_path, int verbose)
+{
+	struct histogram *total = NULL, *h;
+	int i;
+
+	for (i = 0; i < n; ++i) {
+		h = histogram_load(paths[i]);
+		if (!h)
+			fatal("cannot read %s: %s", paths[i], strerror(errno));
+		if (!total) {
+			total = h;
+			continue;
+		}
+		if (histogram_merge(total, h))
+			fatal("%s was measured differently:\n  %s\nnot\n  %s", paths[i],
+			      histogram_config(h), histogram_config(total));
+		histogram_free(h);
+	}
+	if (verbose)
+		printf("> merged %d summaries of: %s\n", n, histogram_config(total));
+	histogram_report(total, stdout, !verbose);
+	if (summary_path && histogram_save(total, summary_path))
+		fatal("cannot write %s: %s", summary_path, strerror(errno));
+	histogram_free(total);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	static char short_options[] = "hVlau:y:T:g:to:i:RP:s:S:w:r123456x";
+	static struct option long_options[] = {
+		{"help", 0, NULL, 'h'},
+		{"version", 0, NULL, 'V'},
+		{"list", 0, NULL, 'l'},
+		{"raw", 0, NULL, 'a'},
+		{"uart", 1, NULL, 'u'},
+		{"system", 1, NULL, 'y'},
+		{"timeout", 1, NULL, 'T'},
+		{"grace", 1, NULL, 'g'},
+		{"terse", 0, NULL, 't'},
+		{"output", 1, NULL, 'o'},
+		{"input", 1, NULL, 'i'},
+		{"realtime", 0, NULL, 'R'},
+		{"priority", 1, NULL, 'P'},
+		{"skip", 1, NULL, 's'},
+		{"samples", 1, NULL, 'S'},
+		{"wait", 1, NULL, 'w'},
+		{"random-wait", 0, NULL, 'r'},
+		{"sysex-sweep", 1, NULL, OPT_SYSEX_SWEEP},
+		{"clock", 1, NULL, OPT_CLOCK},
+		{"active-sensing", 0, NULL, OPT_ACTIVE_SENSING},
+		{"cc-stream", 1, NULL, OPT_CC_STREAM},
+		{"sysex-traffic", 1, NULL, OPT_SYSEX_TRAFFIC},
+		{"seq-chain", 1, NULL, OPT_SEQ_CHAIN},
+		{"seq-fanout", 1, NULL, OPT_SEQ_FANOUT},
+		{"forensics", 2, NULL, OPT_FORENSICS},
+		{"trace-marker", 0, NULL, OPT_TRACE_MARKER},
+		{"trace-json", 1, NULL, OPT_TRACE_JSON},
+		{"save", 1, NULL, OPT_SAVE},
+		{"compare", 1, NULL, OPT_COMPARE},
+		{"max-regression", 1, NULL, OPT_MAX_REGRESSION},
+		{"max-latency", 1, NULL, OPT_MAX_LATENCY},
+		{"ci-width", 1, NULL, OPT_CI_WIDTH},
+		{"ci-percentiles", 1, NULL, OPT_CI_PERCENTILES},
+		{"max-time", 1, NULL, OPT_MAX_TIME},
+		{"daemon", 1, NULL, OPT_DAEMON},
+		{"textfile", 1, NULL, OPT_TEXTFILE},
+		{"socket", 1, NULL, OPT_SOCKET},
+		{"duplex", 1, NULL, OPT_DUPLEX},
+		{"output2", 1, NULL, OPT_OUTPUT2},
+		{"input2", 1, NULL, OPT_INPUT2},
+		{"phase-sweep", 1, NULL, OPT_PHASE_SWEEP},
+		{"burst", 1, NULL, OPT_BURST},
+		{"single-write", 0, NULL, OPT_BURST_WRITE},
+		{"ump", 1, NULL, OPT_UMP},
+		{"ump-jr", 0, NULL, OPT_UMP_JR},
+		{"policy", 1, NULL, OPT_POLICY},
+		{"nice", 1, NULL, OPT_NICE},
+		{"dl-runtime", 1, NULL, OPT_DL_RUNTIME},
+		{"sched-compare", 1, NULL, OPT_SCHED_COMPARE},
+		{"summary", 1, NULL, OPT_SUMMARY},
+		{"merge", 0, NULL, OPT_MERGE},
+		{"heatmap", 0, NULL, OPT_HEATMAP},
+		{"heatmap-svg", 1, NULL, OPT_HEATMAP_SVG},
+		{"probe-types", 2, NULL, OPT_PROBE_TYPES},
+		{}
+	};
+	int do_list = 0;
+	int do_realtime = 0;
+	int rt_prio = sched_get_priority_max(SCHED_FIFO);
+	unsigned int skip_samples = 0;
+	int auto_skip = 0;
+	int nr_samples = 10000;
+	int random_wait = 0;
+    int precision = 1;
+    int high_precision_display = 1;
+    int debug = 1;
+	double wait = 0.0;
+	const char *output_name = NULL;
+	const char *input_name = NULL;
+	int c, err;
+	int use_rawmidi = 0;
+#ifdef ENABLE_UART
+	int use_uart = 0;
+	int uart_speed = 0;
+	const char* system_exec = NULL;
+#endif // ENABLE_UART
+	unsigned int timeout = 1000;
+	unsigned int grace = 0;
+	int verbose = 1;
+	size_t sweep_min = 0, sweep_max = 0;
+	struct traffic traffic = { .nr_sources = 0 };
+	unsigned char traffic_msg[3];
+	size_t traffic_size;
+	double traffic_ms;
+	int chain_max = 0, fanout_max = 0;
+	int do_forensics = 0;
+	unsigned int forensics_threshold = 0;
+	int do_trace_marker = 0;
+	const char *trace_json_path = NULL;
+	const char *save_path = NULL;
+	const char *compare_path = NULL;
+	double max_regression = 10.0;
+	unsigned int max_latency = 6000000; // latencies <= 6ms are o.k. imho
+	double max_latency_ms;
+	struct ci_target ci = { .points = { 50, 99 }, .nr_points = 2 };
+	double max_time = 0;
+	double daemon_rate = 0;
+	const char *textfile_path = NULL;
+	const char *socket_path = NULL;
+	double duplex_rate = 0;
+	const char *output2_name = NULL;
+	const char *input2_name = NULL;
+	double phase_period = 0;
+	int phase_steps = 16;
+	int burst_channels = 0, burst_notes = 1;
+	int single_write = 0;
+	int ump_bits = 0, ump_jr = 0;
+	struct sched_setting sched = { .policy = SCHED_FIFO };
+	double sched_compare_rate = 0;
+	const char *summary_path = NULL;
+	int do_merge = 0;
+	struct histogram *summary = NULL;
+	char summary_config[200];
+	int do_heatmap = 0;
+	const char *heatmap_svg = NULL;
+	struct heatmap *heatmap = NULL;
+	unsigned int probe_type_mask = 0;
+
+	while ((c = getopt_long(argc, argv, short_options,
+				long_options, NULL)) != -1) {
+		switch (c) {
+		case 'a':
+			use_rawmidi = 1;
+			break;
+#ifdef ENABLE_UART
+		case 'u':
+			use_uart = 1;
+			uart_speed = atoi(optarg);
+			break;
+		case 'y':
+			system_exec = optarg;
+			break;
+#endif //ENABLE_UART
+		case 'h':
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		case 'V':
+			print_version();
+			return EXIT_SUCCESS;
+		case 'l':
+			do_list = 1;
+			break;
+		case 'o':
+			output_name = optarg;
+			break;
+		case 'i':
+			input_name = optarg;
+			break;
+		case 'R':
+			do_realtime = 1;
+			break;
+		case 'P':
+			rt_prio = atoi(optarg);
+			if (rt_prio > sched_get_priority_max(SCHED_FIFO)) {
+				printf("> Warning: Given priority:   %d > sched_get_priority_max(SCHED_FIFO)! ", rt_prio);
+				printf("Setting priority to %d.\n", sched_get_priority_max(SCHED_FIFO));
+				rt_prio = sched_get_priority_max(SCHED_FIFO);
+			} else if (rt_prio < sched_get_priority_min(SCHED_FIFO)) {
+				printf("> Warning: Given priority:   %d < sched_get_priority_min(SCHED_FIFO)! ", rt_prio);
+				printf("Setting priority to %d.\n", sched_get_priority_min(SCHED_FIFO));
+				rt_prio = sched_get_priority_min(SCHED_FIFO);
+			}
+			break;
+		case 's':
+			if (!strcmp(optarg, "auto"))
+				auto_skip = 1;
+			else
+				skip_samples = atoi(optarg);
+			break;
+		case 'S':
+			nr_samples = atoi(optarg);
+			if (nr_samples <= 0) {
+				printf("> Warning: Given number of samples to take is less or equal zero! ");
+				printf("Setting nr of samples to take to 1.\n");
+				nr_samples = 1;
+			}
+			break;
+		case 'T':
+			timeout = atoi(optarg);
+			break;
+		case 'g':
+			grace = atoi(optarg);
+			break;
+		case 't':
+			verbose = 0;
+			debug = 0;
+			break;
+		case 'w':
+			wait = atof(optarg);
+			if (wait < 0) {
+				printf("> Warning: Wait time is negative; using zero.\n");
+				wait = 0;
+			}
+			break;
+		case 'r':
+			random_wait = 1;
+			break;
+        case '1':
+            precision = 1;
+            high_precision_display = 1;
+            break;
+        case '2':
+            precision = 2;
+            high_precision_display = 10;
+            break;
+        case '3':
+            precision = 3;
+            high_precision_display = 100;
+            break;
+        case '4':
+            precision = 4;
+            high_precision_display = 1000;
+            break;
+        case '5':
+            precision = 5;
+            high_precision_display = 10000;
+            break;
+        case '6':
+            precision = 6;
+            high_precision_display = 100000;
+            break;
+        case 'x':
+            debug = 0;
+            break;
+		case OPT_SYSEX_SWEEP:
+			if (sscanf(optarg, "%zu:%zu", &sweep_min, &sweep_max) != 2 ||
+			    sweep_min < 3 || sweep_max < sweep_min)
+				fatal("invalid SysEx sweep range '%s', expected min:max with 3 <= min <= max", optarg);
+			break;
+		case OPT_CLOCK:
+			/* 24 clocks per quarter note */
+			traffic_msg[0] = 0xf8;
+			add_traffic(&traffic, "clock", atof(optarg) * 24 / 60, traffic_msg, 1, 0);
+			break;
+		case OPT_ACTIVE_SENSING:
+			traffic_msg[0] = 0xfe;
+			add_traffic(&traffic, "active sensing", 1000.0 / 300, traffic_msg, 1, 0);
+			break;
+		case OPT_CC_STREAM:
+			/* modulation wheel on channel 16, away from the probe */
+			traffic_msg[0] = 0xbf;
+			traffic_msg[1] = 1;
+			traffic_msg[2] = 0;
+			add_traffic(&traffic, "controllers", atof(optarg), traffic_msg, 3, 1);
+			break;
+		case OPT_SYSEX_TRAFFIC:
+			if (sscanf(optarg, "%zu:%lf", &traffic_size, &traffic_ms) != 2 ||
+			    traffic_size < 3 || traffic_ms <= 0)
+				fatal("invalid SysEx traffic '%s', expected bytes:ms with bytes >= 3", optarg);
+			unsigned char *sysex = malloc(traffic_size);
+			check_mem(sysex);
+			fill_sysex(sysex, traffic_size, 0);
+			add_traffic(&traffic, "SysEx", 1000.0 / traffic_ms, sysex, traffic_size, 0);
+			free(sysex);
+			break;
+		case OPT_SEQ_CHAIN:
+			chain_max = atoi(optarg);
+			if (chain_max < 1)
+				fatal("the chain needs at least one hop");
+			break;
+		case OPT_FORENSICS:
+			do_forensics = 1;
+			if (optarg)
+				forensics_threshold = atof(optarg) * 1000000;
+			break;
+		case OPT_TRACE_MARKER:
+			do_trace_marker = 1;
+			break;
+		case OPT_TRACE_JSON:
+			trace_json_path = optarg;
+			break;
+		case OPT_SAVE:
+			save_path = optarg;
+			break;
+		case OPT_COMPARE:
+			compare_path = optarg;
+			break;
+		case OPT_MAX_REGRESSION:
+			max_regression = atof(optarg);
+			if (max_regression < 0)
+				fatal("the allowed regression cannot be negative");
+			break;
+		case OPT_MAX_LATENCY:
+			max_latency_ms = atof(optarg);
+			/* kept in ns, in an unsigned int */
+			if (!(max_latency_ms >= 0 && max_latency_ms <= UINT_MAX / 1000000))
+				fatal("the latency limit must be from 0 to %u ms",
+				      UINT_MAX / 1000000);
+			max_latency = max_latency_ms * 1000000;
+			break;
+		case OPT_CI_WIDTH:
+			ci.width = atof(optarg);
+			if (ci.width <= 0)
+				fatal("the interval width must be positive");
+			break;
+		case OPT_CI_PERCENTILES:
+			parse_percentiles(&ci, optarg);
+			break;
+		case OPT_MAX_TIME:
+			max_time = atof(optarg);
+			break;
+		case OPT_DAEMON:
+			daemon_rate = atof(optarg);
+			if (daemon_rate <= 0 || daemon_rate > 100)
+				fatal("the probe rate must be above 0 and at most 100 Hz");
+			break;
+		case OPT_TEXTFILE:
+			textfile_path = optarg;
+			break;
+		case OPT_SOCKET:
+			socket_path = optarg;
+			break;
+		case OPT_DUPLEX:
+			duplex_rate = atof(optarg);
+			if (duplex_rate <= 0)
+				fatal("the probe rate must be positive");
+			break;
+		case OPT_OUTPUT2:
+			output2_name = optarg;
+			break;
+		case OPT_INPUT2:
+			input2_name = optarg;
+			break;
+		case OPT_PHASE_SWEEP:
+			phase_period = atof(optarg);
+			if (strchr(optarg, ':'))
+				phase_steps = atoi(strchr(optarg, ':') + 1);
+			if (phase_period < 1 || phase_steps < 2)
+				fatal("invalid phase sweep: %s", optarg);
+			break;
+		case OPT_BURST:
+			burst_channels = atoi(optarg);
+			if (strchr(optarg, ':'))
+				burst_notes = atoi(strchr(optarg, ':') + 1);
+			if (burst_channels < 1 || burst_channels > 16 ||
+			    burst_notes < 1 || burst_notes > 64)
+				fatal("invalid burst: %s", optarg);
+			break;
+		case OPT_BURST_WRITE:
+			single_write = 1;
+			break;
+		case OPT_UMP:
+			ump_bits = atoi(optarg);
+			if (ump_bits != 32 && ump_bits != 64 && ump_bits != 128)
+				fatal("UMP probes are 32, 64 or 128 bits");
+			break;
+		case OPT_UMP_JR:
+			ump_jr = 1;
+			break;
+		case OPT_POLICY:
+			if (!strcmp(optarg, "fifo"))
+				sched.policy = SCHED_FIFO;
+			else if (!strcmp(optarg, "rr"))
+				sched.policy = SCHED_RR;
+			else if (!strcmp(optarg, "other"))
+				sched.policy = SCHED_OTHER;
+			else if (!strcmp(optarg, "deadline"))
+				sched.policy = SCHED_DEADLINE;
+			else
+				fatal("unknown scheduling policy: %s", optarg);
+			do_realtime = 1;
+			break;
+		case OPT_NICE:
+			sched.nice = atoi(optarg);
+			if (sched.nice < -20 || sched.nice > 19)
+				fatal("nice values go from -20 to 19");
+			break;
+		case OPT_DL_RUNTIME:
+			sched.runtime_ns = atof(optarg) * 1000;
+			if (sched.runtime_ns < 1024)
+				fatal("the runtime must be at least about 1 us");
+			break;
+		case OPT_SUMMARY:
+			summary_path = optarg;
+			break;
+		case OPT_MERGE:
+			do_merge = 1;
+			break;
+		case OPT_HEATMAP:
+			do_heatmap = 1;
+			break;
+		case OPT_HEATMAP_SVG:
+			heatmap_svg = optarg;
+			break;
+		case OPT_PROBE_TYPES:
+			probe_type_mask = optarg ? parse_probe_types(optarg) :
+				(1U << ARRAY_SIZE(probe_types)) - 1;
+			break;
+		case OPT_SCHED_COMPARE:
+			sched_compare_rate = atof(optarg);
+			if (sched_compare_rate <= 0)
+				fatal("the probe rate must be positive");
+			break;
+		case OPT_SEQ_FANOUT:
+			fanout_max = atoi(optarg);
+			if (fanout_max < 1)
+				fatal("the fan-out needs at least one subscriber");
+			break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (do_merge) {
+		if (!argv[optind])
+			fatal("--merge needs the summaries to merge");
+		return run_merge(argv + optind, argc - optind, summary_path, verbose);
+	}
+	if (argc == 1 || argv[optind]) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int use_seq = 1;
+	// temporarily change the ALSA error handler to silence warning in case
+	// /dev/snd/seq doesn't exist (e.g.: lacks kernel support or module not
+	// loaded)
+	snd_lib_error_set_handler(quiet_error_handler);
+	err = snd_seq_open(&seq, "default", SND_SEQ_OPEN_DUPLEX, 0);
+	snd_lib_error_set_handler(NULL); // restore default handler
+	if (err)
+		use_seq = 0;
+
+	if (do_list) {
+		list_ports();
+		return 0;
+	}
+
+	int routing = chain_max || fanout_max;
+	if (routing && !use_seq)
+		fatal("--seq-chain and --seq-fanout need the ALSA sequencer");
+	if (routing && use_rawmidi)
+		fatal("--seq-chain and --seq-fanout do not work with -a");
+#ifdef ENABLE_UART
+	if (routing && use_uart)
+		fatal("--seq-chain and --seq-fanout do not work with -u");
+#endif // ENABLE_UART
+	if (!output_name && !routing)
+		fatal("Please specify an output port with --output.  Use -l to get a list.");
+	if (!input_name && !routing)
+		fatal("Please specify an input port with --input.  Use -l to get a list.");
+	if (!output2_name != !input2_name)
+		fatal("--output2 and --input2 go together");
+	if (output2_name && !duplex_rate && !ump_bits)
+		fatal("--output2 and --input2 need --duplex or --ump");
+	if (ump_jr && !ump_bits)
+		fatal("--ump-jr needs --ump");
+#ifndef ENABLE_UMP
+	if (ump_bits)
+		fatal("UMP support needs alsa-lib 1.2.10 or later at build time");
+#endif // ENABLE_UMP
+	if (ump_bits && (sweep_max || burst_channels || duplex_rate ||
+			 traffic.nr_sources || routing))
+		fatal("--ump works with single probes only");
+	if (traffic.nr_sources && (sweep_max || routing || daemon_rate ||
+				   duplex_rate || phase_period || burst_channels ||
+				   sched_compare_rate || output2_name))
+		fatal("background traffic works with the plain run only");
+	if (probe_type_mask && (traffic.nr_sources || duplex_rate || daemon_rate ||
+				burst_channels || phase_period || sweep_max ||
+				sched_compare_rate || output2_name || routing))
+		fatal("--probe-types works on its own only");
+	if (sched.nice && sched.policy != SCHED_OTHER && !sched_compare_rate)
+		fatal("--nice needs --policy=other or --sched-compare");
+	if (summary_path && (duplex_rate || burst_channels || phase_period ||
+			     sweep_max || sched_compare_rate || output2_name ||
+			     routing || probe_type_mask))
+		fatal("--summary works with the plain run and --daemon only");
+	if ((do_heatmap || heatmap_svg) && (duplex_rate || burst_channels ||
+			phase_period || sweep_max || sched_compare_rate ||
+			output2_name || routing || probe_type_mask))
+		fatal("the heatmap works with the plain run and --daemon only");
+	if (do_realtime && sched.policy == SCHED_DEADLINE && !sched_compare_rate) {
+		if (!wait || random_wait)
+			fatal("--policy=deadline needs a fixed period, given with -w");
+		sched.period_ns = wait * 1000000;
+		if (!sched.runtime_ns)
+			sched.runtime_ns = sched.period_ns / 4;
+	}
+	if (sched_compare_rate && !sched.runtime_ns)
+		sched.runtime_ns = 1000000000.0 / sched_compare_rate / 4;
+	if ((sched_compare_rate || sched.policy == SCHED_DEADLINE) &&
+	    sched.runtime_ns > (sched_compare_rate ?
+			1000000000.0 / sched_compare_rate : sched.period_ns))
+		fatal("the deadline runtime cannot be longer than the period");
+	// ensure that exactly one of rawmidi or seq is enabled
+	if (use_rawmidi)
+		use_seq = 0;
+	else
+		use_rawmidi = !use_seq;
 #ifdef ENABLE_UART
 	if (use_uart)
 		use_rawmidi = use_seq = 0;
 #endif // ENABLE_UART
-	if (use_rawmidi) {
-		err = snd_rawmidi_open(&raw_in, NULL, input_name, SND_RAWMIDI_NONBLOCK);
-		check_snd("open input", err);
-		err = snd_rawmidi_open(NULL, &raw_out, output_name, SND_RAWMIDI_SYNC);
-		check_snd("open output", err);
-	}
+	struct link link, link2;
+	link.type = use_seq ? LINK_SEQ : use_rawmidi ? LINK_RAWMIDI : LINK_UART;
+	link.output_name = output_name;
+	link.input_name = input_name;
+	link.ump_bits = ump_bits;
+	link.ump_jr = ump_jr;
+	link2.type = link.type;
+	link2.output_name = output2_name;
+	link2.input_name = input2_name;
+	link2.ump_bits = link2.ump_jr = 0;
+	if (ump_bits) {
 #ifdef ENABLE_UART
-	int uart_fd_in = -1;
-	int uart_fd_out= -1;
-	if (use_uart) {
-		uart_fd_in = open(input_name, O_RDWR | O_NOCTTY | O_SYNC
-				);
-		if (uart_fd_in < 0)
-			check_posix("open input", errno);
-		uart_fd_out = open(output_name, O_RDWR | O_NOCTTY | O_SYNC
-				);
-		if (uart_fd_out < 0)
-			check_posix("open output", errno);
-		unsigned int baudRate = speedToBaudRate(uart_speed);
-		if(B0 == baudRate) {
-			fprintf(stderr, "Error setting BAUD rate: %d speed not supported\n", uart_speed);
-			return -1;
+		if (use_uart)
+			fatal("--ump does not work with --uart");
+#endif // ENABLE_UART
+		if (ump_jr && use_seq)
+			fatal("--ump-jr needs -a; the sequencer drops JR Timestamps");
+		/* the MIDI 1.0 ports of the same device, for comparison */
+		link2.type = LINK_RAWMIDI;
+		if (use_rawmidi)
+			link.type = LINK_UMP;
+		else if (output2_name)
+			fatal("comparing against MIDI 1.0 needs -a; with the sequencer, use --save and --compare on two runs");
+	}
+	if (use_seq) {
+		err = snd_seq_set_client_name(seq, "alsa-midi-latency-test");
+		check_snd("set client name", err);
+#ifdef ENABLE_UMP
+		if (ump_bits) {
+			err = snd_seq_set_client_midi_version(seq, SND_SEQ_CLIENT_UMP_MIDI_2_0);
+			check_snd("set client MIDI version", err);
 		}
-		setInterfaceAttribs(uart_fd_in, baudRate);
-		setInterfaceAttribs(uart_fd_out, baudRate);
-		setMinCount(uart_fd_in, 0); /* set to pure timed read */
-		setMinCount(uart_fd_out, 0); /* set to pure timed read */
+#endif // ENABLE_UMP
+		int client = snd_seq_client_id(seq);
+		check_snd("get client id", client);
 	}
+#ifdef ENABLE_UART
+	if (!routing)
+		open_link(&link, uart_speed);
+	if (output2_name)
+		open_link(&link2, uart_speed);
 	if (system_exec) {
 		err = system(system_exec);
 		if (err) {
@@ -751,28 +3813,12 @@ int main(int argc, char *argv[])
 			return 1;
 		}
 	}
+#else
+	if (!routing)
+		open_link(&link, 0);
+	if (output2_name)
+		open_link(&link2, 0);
 #endif // ENABLE_UART
-	int port;
-	int client;
-	if (use_seq) {
-		err = snd_seq_parse_address(seq, &output_addr, output_name);
-		check_snd("parse output port", err);
-		err = snd_seq_parse_address(seq, &input_addr, input_name);
-		check_snd("parse input port", err);
-
-		err = snd_seq_set_client_name(seq, "alsa-midi-latency-test");
-		check_snd("set client name", err);
-		client = snd_seq_client_id(seq);
-		check_snd("get client id", client);
-		port = snd_seq_create_simple_port(seq, "alsa-midi-latency-test",
-						      SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SYNC_WRITE,
-						      SND_SEQ_PORT_TYPE_APPLICATION);
-		check_snd("create port", port);
-		err = snd_seq_connect_to(seq, port, output_addr.client, output_addr.port);
-		check_snd("connect output port", err);
-		err = snd_seq_connect_from(seq, port, input_addr.client, input_addr.port);
-		check_snd("connect input port", err);
-	}
 
 	if (verbose) {
 		print_version();
@@ -782,20 +3828,28 @@ int main(int argc, char *argv[])
 	if (random_wait)
 		srand(getRandomNumber());
 
-	if (do_realtime) {
-		if(verbose)
-			printf("> set_realtime_priority(SCHED_FIFO, %d).. ", rt_prio);
-		set_realtime_priority(SCHED_FIFO, rt_prio);
-		if (verbose)
+	if (do_realtime && !sched_compare_rate) {
+		sched.prio = rt_prio;
+		if (verbose) {
+			if (sched.policy == SCHED_DEADLINE)
+				printf("> set_realtime_priority(%s, %llu/%llu us).. ",
+				       policy_name(sched.policy),
+				       sched.runtime_ns / 1000, sched.period_ns / 1000);
+			else
+				printf("> set_realtime_priority(%s, %d).. ",
+				       policy_name(sched.policy),
+				       sched.policy == SCHED_OTHER ? sched.nice : rt_prio);
+		}
+		if (set_realtime_priority(&sched)) {
+			/* go on paced by -w alone, and report no policy */
+			do_realtime = 0;
+			if (verbose)
+				printf("failed.\n");
+		} else if (verbose) {
 			printf("done.\n");
+		}
 	}
 
-#if defined(CLOCK_MONOTONIC_RAW)
-#define HR_CLOCK CLOCK_MONOTONIC_RAW
-#else
-#define HR_CLOCK CLOCK_MONOTONIC
-#endif
-
 	struct timespec begin, end;
 	if (clock_gettime(HR_CLOCK, &begin) < 0)
 		fatal("monotonic raw clock not supported");
@@ -812,7 +3866,7 @@ int main(int argc, char *argv[])
 			printf("> interval between measurements: %.3f ms\n", wait);
 	}
 
-	if (verbose) {
+	if (verbose && !daemon_rate) {
 		printf("\n> sampling %d midi latency values - please wait …\n", nr_samples);
 		printf("> press Ctrl+C to abort test\n");
 	}
@@ -820,9 +3874,131 @@ int main(int argc, char *argv[])
 	signal(SIGINT,  sighandler);
 	signal(SIGTERM, sighandler);
 
+	if (routing) {
+		err = run_seq_routing(chain_max, fanout_max, nr_samples, timeout,
+				      wait, random_wait, verbose);
+		snd_seq_close(seq);
+		return err;
+	}
+
+	prepare_link(&link);
+
+	if (summary_path) {
+		static const char *const link_names[] = { "seq", "rawmidi", "uart", "ump" };
+
+		/* what makes two runs comparable; not the port names, which vary by host */
+		snprintf(summary_config, sizeof(summary_config),
+			 "link=%s ump=%d%s probe=noteon wait=%g%s sched=%s/%d traffic=%d daemon=%g",
+			 link_names[link.type], ump_bits, ump_jr ? "+jr" : "",
+			 wait, random_wait ? "+random" : "",
+			 do_realtime ? policy_name(sched.policy) : "none",
+			 do_realtime ? rt_prio : 0, traffic.nr_sources, daemon_rate);
+		summary = histogram_new(summary_config);
+		check_mem(summary);
+	}
+	if (do_heatmap || heatmap_svg) {
+		heatmap = heatmap_new();
+		check_mem(heatmap);
+	}
+
+	if (duplex_rate) {
+		if (output2_name)
+			prepare_link(&link2);
+		err = run_duplex(&link, output2_name ? &link2 : NULL, nr_samples,
+				 duplex_rate, timeout, verbose);
+		if (output2_name)
+			close_link(&link2);
+		close_link(&link);
+		if (seq)
+			snd_seq_close(seq);
+		return err;
+	}
+
+	if (daemon_rate) {
+		err = run_daemon(&link, daemon_rate, timeout, textfile_path,
+				 socket_path, summary, heatmap, verbose);
+		if (heatmap)
+			finish_heatmap(heatmap, heatmap_svg, do_heatmap && verbose);
+		if (summary && histogram_save(summary, summary_path))
+			fatal("cannot write %s: %s", summary_path, strerror(errno));
+		histogram_free(summary);
+		close_link(&link);
+		if (seq)
+			snd_seq_close(seq);
+		return err;
+	}
+
+	if (probe_type_mask) {
+		err = run_probe_types(&link, probe_type_mask, nr_samples, timeout,
+				      wait, random_wait, verbose);
+		close_link(&link);
+		if (seq)
+			snd_seq_close(seq);
+		return err;
+	}
+
+	if (sched_compare_rate) {
+		err = run_sched_compare(&link, sched_compare_rate, nr_samples,
+					timeout, rt_prio, sched.nice,
+					sched.runtime_ns, verbose);
+		close_link(&link);
+		if (seq)
+			snd_seq_close(seq);
+		return err;
+	}
+
+	if (ump_bits && output2_name) {
+		prepare_link(&link2);
+		err = run_ump_compare(&link, &link2, nr_samples, timeout, wait,
+				      random_wait, verbose);
+		close_link(&link2);
+		close_link(&link);
+		return err;
+	}
+
+	if (burst_channels) {
+		err = run_burst(&link, burst_channels, burst_notes, single_write,
+				nr_samples, timeout, wait, random_wait, verbose);
+		close_link(&link);
+		if (seq)
+			snd_seq_close(seq);
+		return err;
+	}
+
+	if (phase_period) {
+		err = run_phase_sweep(&link, phase_period * 1000, phase_steps,
+				      nr_samples, timeout, verbose);
+		close_link(&link);
+		if (seq)
+			snd_seq_close(seq);
+		return err;
+	}
+
+	if (sweep_max) {
+		err = run_sysex_sweep(&link, sweep_min, sweep_max, nr_samples,
+				      timeout, wait, random_wait, verbose,
+#ifdef ENABLE_UART
+				      use_uart ? uart_speed : 0);
+#else
+				      0);
+#endif // ENABLE_UART
+		close_link(&link);
+		if (seq)
+			snd_seq_close(seq);
+		return err;
+	}
+
 	unsigned int *delays = calloc(nr_samples, sizeof *delays);
 	check_mem(delays);
 
+	unsigned int *baseline = NULL, baseline_nr = 0;
+	if (compare_path) {
+		baseline = load_samples(compare_path, &baseline_nr);
+		if (!baseline)
+			fatal("cannot read %s: %s", compare_path, strerror(errno));
+		qsort(baseline, baseline_nr, sizeof(*baseline), compare_unsigned_int);
+	}
+
 	if (skip_samples) {
 		if (skip_samples == 1) {
 			if(verbose)
@@ -833,62 +4009,72 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (debug == 1)
-		printf("\nsample; latency_ms; latency_ms_worst\n");
+	struct forensics *forensics = NULL;
+	if (do_forensics) {
+		forensics = forensics_new(FORENSICS_RECORDS, FORENSICS_REFRESH_MS);
+		check_mem(forensics);
+	}
 
-	snd_seq_event_t ev;
-	int pollfds_count;
-	struct pollfd *pollfds;
-	err = 0;
-	if (use_seq)
-	{
-		snd_seq_ev_clear(&ev);
-		snd_seq_ev_set_dest(&ev, output_addr.client, output_addr.port);
-		snd_seq_ev_set_source(&ev, port);
-		snd_seq_ev_set_direct(&ev);
-		snd_seq_ev_set_noteon(&ev, 0, 60, 127);
-
-		pollfds_count = snd_seq_poll_descriptors_count(seq, POLLIN);
-		pollfds = alloca(pollfds_count * sizeof *pollfds);
-		err = snd_seq_poll_descriptors(seq, pollfds, pollfds_count, POLLIN);
+	struct probe_times probe_times;
+	struct trace_json *trace_json = NULL;
+	if (do_trace_marker) {
+		link.marker_fd = trace_marker_open();
+		if (link.marker_fd < 0)
+			fatal("cannot open trace_marker: %s", strerror(errno));
 	}
-	const unsigned char test_status_byte = 0x90;
-	char msg[3] = { test_status_byte, 60, 127 };
-	if (use_rawmidi)
-	{
-		pollfds_count = snd_rawmidi_poll_descriptors_count(raw_in);
-		pollfds = alloca(pollfds_count * sizeof *pollfds);
-		err = snd_rawmidi_poll_descriptors(raw_in, pollfds, pollfds_count);
-		snd_rawmidi_drain(raw_in);
-		snd_rawmidi_drain(raw_out);
-		// not sure if this is documented anwhere, but in practical
-		// applications we find that one needs to poll() at least once
-		// before incoming messages start being queued.
-		// skipping this dummy poll() here would result in the first
-		// response message not being received if the roundtrip is so
-		// fast that the first call to poll() happens after the
-		// device has sent back its response
-		poll(pollfds, pollfds_count, 0);
+	if (trace_json_path) {
+		trace_json = trace_json_open(trace_json_path);
+		if (!trace_json)
+			fatal("cannot create %s: %s", trace_json_path, strerror(errno));
+		link.times = &probe_times;
 	}
-	check_snd("get poll descriptors", err);
-	pollfds_count = err;
-#ifdef ENABLE_UART
-	if (use_uart)
-	{
-		pollfds_count = 1;
-		pollfds = alloca(pollfds_count * sizeof(*pollfds));
-		pollfds[0].fd = uart_fd_in;
-		pollfds[0].events = POLLIN;
-		poll(pollfds, pollfds_count, 0);
+	if ((do_trace_marker || trace_json) && verbose)
+		printf("> tracing on CLOCK_MONOTONIC, use 'echo mono > /sys/kernel/tracing/trace_clock' to match\n");
+
+	unsigned char *loaded = NULL;
+	if (traffic.nr_sources) {
+		loaded = calloc(nr_samples, sizeof *loaded);
+		check_mem(loaded);
+		start_traffic(&traffic, &link);
 	}
-#endif // ENABLE_UART
+
+	if (debug == 1)
+		printf("\nsample; latency_ms; latency_ms_worst\n");
+
+	const unsigned char test_status_byte = 0x90;
+	unsigned char msg[3] = { test_status_byte, 60, 127 };
+	struct probe probe;
+	set_probe(&link, &probe, msg, sizeof(msg));
+
+	/*
+	 * -s auto: everything is warm-up until the first guess, so that the
+	 * live maximum, forensics and timeouts do not see it either
+	 */
+	unsigned int next_mser_check = MSER_CHECK_MIN;
+	if (auto_skip)
+		skip_samples = nr_samples;
 
 	unsigned int sample_nr = 0;
 	unsigned int min_delay = UINT_MAX, max_delay = 0;
 	long unsigned int total_delay = 0;
 	unsigned int graceTimeouts = 0;
+	unsigned int next_ci_check = skip_samples + CI_CHECK_MIN;
+	int ci_done = 0;
+	struct timespec start;
+	if (ci.width) {
+		ci.sorted = malloc(nr_samples * sizeof(*ci.sorted));
+		check_mem(ci.sorted);
+	}
+	clock_gettime(HR_CLOCK, &start);
 	for (c = 0; c < nr_samples; ++c) {
-		if (wait) {
+		if (loaded)
+			traffic.enabled = (c / TRAFFIC_BLOCK) & 1;
+		if (sched.policy == SCHED_DEADLINE && do_realtime) {
+			/* the next period starts the next job */
+			sched_yield();
+			if (signal_received)
+				break;
+		} else if (wait) {
 			if (random_wait)
 				wait_ms(wait + rand() * wait / RAND_MAX);
 			else
@@ -897,119 +4083,113 @@ int main(int argc, char *argv[])
 				break;
 		}
 
-		clock_gettime(HR_CLOCK, &begin);
-
-		if (use_seq)
-			err = snd_seq_event_output_direct(seq, &ev);
-		char rec_msg[3];
-		if (use_rawmidi)
-			err = snd_rawmidi_write(raw_out, msg, sizeof(msg));
-		check_snd("output MIDI event", err);
-#ifdef ENABLE_UART
-		if (use_uart)
-		{
-			err = write(uart_fd_out, msg, sizeof(msg));
-			if (err != sizeof(msg))
-				check_posix("output UART event", errno);
-		}
-#endif // ENABLE_UART
-
-		snd_seq_event_t *rec_ev;
-		int received_something = 0;
-		for (;;) {
-			if (use_seq)
-				rec_ev = NULL;
-			if (
-				use_rawmidi
-#ifdef ENABLE_UART
-				|| use_uart
-#endif // ENABLE_UART
-			)
-				memset(rec_msg, 0, sizeof(rec_msg));
-			err = poll(pollfds, pollfds_count, timeout);
-			if (signal_received)
-			       break;
-			if (err == 0)
-				fatal("timeout: there seems to be no connection between ports %s and %s", output_name, input_name);
-			if (err < 0)
-				fatal("poll error: %s", strerror(errno));
-			unsigned short revents;
-			if (use_seq) {
-				err = snd_seq_poll_descriptors_revents(seq, pollfds, pollfds_count, &revents);
-				check_snd("get poll events", err);
-			} else if (use_rawmidi) {
-				err = snd_rawmidi_poll_descriptors_revents(raw_in, pollfds, pollfds_count, &revents);
-				check_snd("get poll events", err);
-			}
-#ifdef ENABLE_UART
-			if (use_uart)
-				revents = pollfds[0].revents;
-#endif // ENABLE_UART
-			if (revents & (POLLERR | POLLNVAL))
-				break;
-			if (!(revents & POLLIN))
-				continue;
-			if (use_seq) {
-				err = snd_seq_event_input(seq, &rec_ev);
-				check_snd("input MIDI event", err);
-				received_something = 1;
-				if (rec_ev->type == SND_SEQ_EVENT_NOTEON)
-					break;
-			}
-			if (use_rawmidi) {
-				err = snd_rawmidi_read(raw_in, rec_msg, sizeof(rec_msg));
-				check_snd("input MIDI event", err);
-				received_something = 1;
-				if (test_status_byte == rec_msg[0])
-					break;
-			}
-#ifdef ENABLE_UART
-			if (use_uart) {
-				err = read(uart_fd_in, rec_msg, sizeof(rec_msg));
-				// TODO: handle the case where these are not received all at once
-				if (err != sizeof(rec_msg))
-					check_posix("input UART event", errno);
-				received_something = 1;
-				if (test_status_byte == rec_msg[0])
-					break;
-			}
-#endif // ENABLE_UART
-		}
-		if (!received_something)
+		if (!measure_probe(&link, &probe, timeout, &begin, &end))
 			break;
 
-		clock_gettime(HR_CLOCK, &end);
-
 		unsigned int delay_ns = timespec_sub(&end, &begin);
+		if (heatmap)
+			heatmap_add(heatmap, timespec_ns(&begin), delay_ns);
+		if (trace_json)
+			trace_json_sample(trace_json, sample_nr, &probe_times);
 		if (sample_nr < skip_samples) {
 			//if (debug == 1) printf("skipping sample %d\n", sample_nr);
 		} else if (delay_ns > max_delay) {
 			max_delay = delay_ns;
+			if (forensics)
+				check_posix("capture forensics",
+					    forensics_capture(forensics, sample_nr, delay_ns, "new worst case"));
 			if (debug == 1)
 				printf("%6u; %10.*f; %10.*f     \n",
 				       sample_nr, 2 + precision, delay_ns / 1000000.0, 2 + precision, max_delay / 1000000.0);
 		} else {
+			if (forensics && forensics_threshold && delay_ns >= forensics_threshold)
+				check_posix("capture forensics",
+					    forensics_capture(forensics, sample_nr, delay_ns, "over threshold"));
 			if (debug == 1)
 				printf("%6u; %10.*f; %10.*f     \r",
 				       sample_nr, 2 + precision, delay_ns / 1000000.0, 2 + precision, max_delay / 1000000.0);
 		}
 		if (delay_ns < min_delay)
 			min_delay = delay_ns;
+		if (loaded)
+			loaded[sample_nr] = traffic.enabled;
 		delays[sample_nr++] = delay_ns;
 		total_delay += delay_ns;
 
-		ev.data.note.channel ^= 1; // prevent running status
+		msg[0] ^= 1; // prevent running status
+		set_probe(&link, &probe, msg, sizeof(msg));
+		if (forensics)
+			check_posix("capture forensics", forensics_tick(forensics));
 
 		if (delay_ns >= (timeout * 1000000 / 2) && sample_nr >= skip_samples) {
 			++graceTimeouts;
 		}
+		if (auto_skip && sample_nr >= next_mser_check) {
+			unsigned int k;
+
+			/* move the cut and recount what was counted from the old one */
+			skip_samples = mser_truncation(delays, sample_nr);
+			max_delay = 0;
+			graceTimeouts = 0;
+			for (k = skip_samples; k < sample_nr; ++k) {
+				if (delays[k] > max_delay)
+					max_delay = delays[k];
+				if (delays[k] >= (timeout * 1000000 / 2))
+					++graceTimeouts;
+			}
+			if (forensics)
+				forensics_drop_before(forensics, skip_samples);
+			if (next_ci_check > (unsigned int)nr_samples)
+				next_ci_check = skip_samples + CI_CHECK_MIN;
+			next_mser_check = sample_nr + sample_nr / 10;
+			if (next_mser_check < sample_nr + MSER_CHECK_MIN)
+				next_mser_check = sample_nr + MSER_CHECK_MIN;
+		}
 		if (grace && graceTimeouts >= grace) {
 			fprintf(stderr, "Exiting earlier because of %d timeouts / 2\n", graceTimeouts);
 			break;
 		}
+		if (ci.width && sample_nr >= next_ci_check) {
+			ci_done = ci_reached(&ci, delays + skip_samples, sample_nr - skip_samples);
+			if (ci_done)
+				break;
+			next_ci_check = sample_nr + (sample_nr - skip_samples) / 10;
+			if (next_ci_check < sample_nr + CI_CHECK_MIN)
+				next_ci_check = sample_nr + CI_CHECK_MIN;
+		}
+		if (max_time && timespec_sub_ns(&end, &start) >= max_time * 1000000000.0)
+			break;
 	}
+	if (loaded)
+		stop_traffic(&traffic);
 	unsigned int mean_delay = total_delay / sample_nr;
 
+	if (auto_skip) {
+		skip_samples = mser_truncation(delays, sample_nr);
+		if (forensics)
+			forensics_drop_before(forensics, skip_samples);
+		if (verbose) {
+			printf("\n> warm-up detected by MSER-%d: %u samples\n",
+			       MSER_BATCH, skip_samples);
+			printf("            samples     min_ms    mean_ms     max_ms\n");
+			print_delay_stats("warm-up", delays, skip_samples);
+			print_delay_stats("steady", delays + skip_samples,
+					  sample_nr - skip_samples);
+		}
+		/* everything from here on describes the steady state only */
+		min_delay = UINT_MAX;
+		max_delay = 0;
+		total_delay = 0;
+		for (c = skip_samples; c < (int)sample_nr; ++c) {
+			if (delays[c] < min_delay)
+				min_delay = delays[c];
+			if (delays[c] > max_delay)
+				max_delay = delays[c];
+			total_delay += delays[c];
+		}
+		mean_delay = total_delay / (sample_nr - skip_samples);
+	}
+
 	if (verbose)
 		printf("\n> done.\n\n> latency distribution:\n");
 
@@ -1061,15 +4241,51 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (use_seq)
-		snd_seq_close(seq);
-	if (use_rawmidi) {
-		snd_rawmidi_close(raw_in);
-		snd_rawmidi_close(raw_out);
+	if (heatmap)
+		finish_heatmap(heatmap, heatmap_svg, do_heatmap && verbose);
+	if (loaded && verbose)
+		print_traffic_report(&traffic, delays, loaded, skip_samples,
+				     sample_nr, precision);
+	if (forensics && verbose)
+		forensics_report(forensics, stdout);
+	forensics_free(forensics);
+	if (ci.width && verbose)
+		print_ci_report(&ci, delays + skip_samples, sample_nr - skip_samples, ci_done);
+	free(ci.sorted);
+
+	if (save_path && save_samples(save_path, delays + skip_samples,
+				      sample_nr - skip_samples))
+		fatal("cannot write %s: %s", save_path, strerror(errno));
+	if (summary) {
+		for (i = skip_samples; i < sample_nr; ++i)
+			histogram_add(summary, delays[i]);
+		if (histogram_save(summary, summary_path))
+			fatal("cannot write %s: %s", summary_path, strerror(errno));
+		histogram_free(summary);
 	}
+	int regressed = 0;
+	if (baseline) {
+		unsigned int kept_nr = sample_nr - skip_samples;
+		unsigned int *kept = malloc(kept_nr * sizeof(*kept));
+		check_mem(kept);
+		memcpy(kept, delays + skip_samples, kept_nr * sizeof(*kept));
+		qsort(kept, kept_nr, sizeof(*kept), compare_unsigned_int);
+		regressed = compare_samples(kept, kept_nr, baseline, baseline_nr,
+					    max_regression, COMPARE_ALPHA,
+					    verbose ? stdout : stderr);
+		free(kept);
+		free(baseline);
+	}
+	trace_json_close(trace_json);
+	if (link.marker_fd >= 0)
+		close(link.marker_fd);
+
+	close_link(&link);
+	if (seq)
+		snd_seq_close(seq);
 
 	if (verbose) {
-		if (max_delay / 1000000.0 > 6.0) { // latencies <= 6ms are o.k. imho
+		if (max_delay > max_latency) {
 			printf("\n> FAIL\n");
 			printf("\n best latency was %.2f ms\n", min_delay / 1000000.0);
 			printf(" worst latency was %.2f ms, which is too much. Please check:\n\n", max_delay/1000000.0);
@@ -1083,11 +4299,22 @@ int main(int argc, char *argv[])
 
 			return EXIT_FAILURE;
 
+		} else if (regressed) {
+			printf("\n> REGRESSION\n");
+			printf("\n latencies got more than %g%% worse than in %s, see above.\n\n",
+			       max_regression, compare_path);
+
+			return EXIT_FAILURE;
+
 		} else {
-			qsort(delays, sample_nr, sizeof(delays[0]), compare_unsigned_int);
-			double median = delays[sample_nr / 2];
-			if ((sample_nr & 1) == 0)
-				median = (median + delays[sample_nr / 2 + 1]) / 2.0;
+			/* of the steady state, like best, mean and worst */
+			unsigned int *steady = delays + skip_samples;
+			unsigned int steady_nr = sample_nr - skip_samples;
+
+			qsort(steady, steady_nr, sizeof(steady[0]), compare_unsigned_int);
+			double median = steady[steady_nr / 2];
+			if ((steady_nr & 1) == 0)
+				median = (median + steady[steady_nr / 2 - 1]) / 2.0;
 
 			printf("\n> SUCCESS\n");
 			printf("\n best   latency was %.*f ms\n", precision, min_delay / 1000000.0);
@@ -1112,6 +4339,6 @@ int main(int argc, char *argv[])
 			max_delay / 1000000.0
 		);
 
-		return EXIT_SUCCESS;
+		return regressed ? EXIT_FAILURE : EXIT_SUCCESS;
 	}
 }
@@ -0,0 +1,387 @@
+/*
+ * bench.c - microbenchmarks of the ALSA calls that make up a sample
+ *
+ * Copyright (C) 2009 - 2026 Jakob Flierl <jakob.flierl@gmail.com>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+#include "aconfig.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include <poll.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <alsa/asoundlib.h>
+
+/*
+ * Each call is timed on its own against in-process loopbacks: a sequencer
+ * port that sends to itself, and a virtual rawmidi device whose port is
+ * subscribed to itself.  No MIDI hardware is involved, so a change in
+ * these numbers is a change in alsa-lib or the kernel.
+ */
+
+#ifdef CLOCK_MONOTONIC_RAW
+#define HR_CLOCK CLOCK_MONOTONIC_RAW
+#else
+#define HR_CLOCK CLOCK_MONOTONIC
+#endif
+
+#define POLL_TIMEOUT 1000
+
+struct op {
+	const char *name;
+	unsigned int *ns;
+	unsigned int n;
+};
+
+static unsigned int timer_overhead;
+
+static void fatal(const char *msg, ...)
+{
+	va_list ap;
+
+	va_start(ap, msg);
+	vfprintf(stderr, msg, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+	exit(EXIT_FAILURE);
+}
+
+static void check_mem(void *p)
+{
+	if (!p)
+		fatal("out of memory");
+}
+
+static void check_snd(const char *operation, int err)
+{
+	if (err < 0)
+		fatal("cannot %s - %s", operation, snd_strerror(err));
+}
+
+static inline unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(HR_CLOCK, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void op_init(struct op *op, const char *name, unsigned int count)
+{
+	op->name = name;
+	op->n = 0;
+	op->ns = calloc(count, sizeof(*op->ns));
+	check_mem(op->ns);
+}
+
+/* records a call that took from t0 to t1, less the cost of reading the clock */
+static void op_add(struct op *op, unsigned long long t0, unsigned long long t1)
+{
+	unsigned long long d = t1 - t0;
+
+	d = d > timer_overhead ? d - timer_overhead : 0;
+	op->ns[op->n++] = d > UINT_MAX ? UINT_MAX : d;
+}
+
+static int compare_unsigned_int(const void *p1, const void *p2)
+{
+	unsigned int a = *(const unsigned int *)p1, b = *(const unsigned int *)p2;
+
+	return a < b ? -1 : a > b;
+}
+
+static void op_report(struct op *op, int terse)
+{
+	double mean = 0, var = 0;
+	unsigned int i, n = op->n;
+
+	if (!n)
+		return;
+	for (i = 0; i < n; ++i)
+		mean += op->ns[i];
+	mean /= n;
+	for (i = 0; i < n; ++i)
+		var += (op->ns[i] - mean) * (op->ns[i] - mean);
+	var /= n > 1 ? n - 1 : 1;
+	qsort(op->ns, n, sizeof(*op->ns), compare_unsigned_int);
+	if (terse)
+		printf("%s,%u,%.1f,%.1f,%u,%u,%u,%u\n", op->name, n, mean,
+		       sqrt(var), op->ns[0], op->ns[n / 2],
+		       op->ns[(n - 1) * 99 / 100], op->ns[n - 1]);
+	else
+		printf("  %-36s %9.1f %9.1f %8u %8u %8u %9u\n", op->name, mean,
+		       sqrt(var), op->ns[0], op->ns[n / 2],
+		       op->ns[(n - 1) * 99 / 100], op->ns[n - 1]);
+	free(op->ns);
+}
+
+static void print_header(const char *title, int terse)
+{
+	if (terse)
+		return;
+	printf("\n> %s\n", title);
+	printf("  %-36s %9s %9s %8s %8s %8s %9s\n", "ns/op", "mean", "stddev",
+	       "min", "median", "99%", "max");
+}
+
+/*
+ * back-to-back clock reads; the cheapest one is taken off every other
+ * measurement
+ */
+static void bench_clock(unsigned int count, int terse)
+{
+	struct op op;
+	unsigned long long t0, t1, best = ULLONG_MAX;
+	unsigned int i;
+
+	op_init(&op, "clock_gettime", count);
+	t0 = now_ns();
+	for (i = 0; i < count; ++i) {
+		t1 = now_ns();
+		if (t1 - t0 < best)
+			best = t1 - t0;
+		op.ns[op.n++] = t1 - t0;
+		t0 = t1;
+	}
+	timer_overhead = best;
+	print_header("clock", terse);
+	op_report(&op, terse);
+}
+
+static void bench_seq(unsigned int count, int terse)
+{
+	snd_seq_t *seq;
+	snd_seq_event_t ev, *rec;
+	struct pollfd *pfds;
+	struct op out, poll_idle, poll_ready, revents, in;
+	unsigned long long t0, t1;
+	unsigned short re;
+	unsigned int i;
+	int port, npfds, err;
+
+	err = snd_seq_open(&seq, "default", SND_SEQ_OPEN_DUPLEX, 0);
+	check_snd("open sequencer", err);
+	err = snd_seq_set_client_name(seq, "alsa-midi-latency-bench");
+	check_snd("set client name", err);
+	port = snd_seq_create_simple_port(seq, "bench",
+					  SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_WRITE,
+					  SND_SEQ_PORT_TYPE_APPLICATION);
+	check_snd("create port", port);
+	npfds = snd_seq_poll_descriptors_count(seq, POLLIN);
+	pfds = calloc(npfds, sizeof(*pfds));
+	check_mem(pfds);
+	err = snd_seq_poll_descriptors(seq, pfds, npfds, POLLIN);
+	check_snd("get poll descriptors", err);
+
+	snd_seq_ev_clear(&ev);
+	snd_seq_ev_set_source(&ev, port);
+	snd_seq_ev_set_dest(&ev, snd_seq_client_id(seq), port);
+	snd_seq_ev_set_direct(&ev);
+	snd_seq_ev_set_noteon(&ev, 0, 0x3c, 0x40);
+
+	op_init(&out, "snd_seq_event_output_direct", count);
+	op_init(&poll_idle, "poll, nothing pending", count);
+	op_init(&poll_ready, "poll, event pending", count);
+	op_init(&revents, "snd_seq_poll_descriptors_revents", count);
+	op_init(&in, "snd_seq_event_input", count);
+	for (i = 0; i < count; ++i) {
+		t0 = now_ns();
+		poll(pfds, npfds, 0);
+		t1 = now_ns();
+		op_add(&poll_idle, t0, t1);
+
+		t0 = now_ns();
+		err = snd_seq_event_output_direct(seq, &ev);
+		t1 = now_ns();
+		check_snd("output event", err);
+		op_add(&out, t0, t1);
+
+		t0 = now_ns();
+		err = poll(pfds, npfds, POLL_TIMEOUT);
+		t1 = now_ns();
+		if (err <= 0)
+			fatal("the sequencer loopback does not deliver");
+		op_add(&poll_ready, t0, t1);
+
+		t0 = now_ns();
+		err = snd_seq_poll_descriptors_revents(seq, pfds, npfds, &re);
+		t1 = now_ns();
+		check_snd("get poll events", err);
+		op_add(&revents, t0, t1);
+
+		t0 = now_ns();
+		err = snd_seq_event_input(seq, &rec);
+		t1 = now_ns();
+		check_snd("input event", err);
+		op_add(&in, t0, t1);
+	}
+	print_header("sequencer, port to itself", terse);
+	op_report(&out, terse);
+	op_report(&poll_idle, terse);
+	op_report(&poll_ready, terse);
+	op_report(&revents, terse);
+	op_report(&in, terse);
+	free(pfds);
+	snd_seq_close(seq);
+}
+
+/* the virtual rawmidi device is a new client that shows up on open */
+static int find_new_client(snd_seq_t *seq, const unsigned char *before)
+{
+	snd_seq_client_info_t *cinfo;
+
+	snd_seq_client_info_alloca(&cinfo);
+	snd_seq_client_info_set_client(cinfo, -1);
+	while (snd_seq_query_next_client(seq, cinfo) >= 0) {
+		int client = snd_seq_client_info_get_client(cinfo);
+		if (client != snd_seq_client_id(seq) && !before[client & 0xff])
+			return client;
+	}
+	return -1;
+}
+
+static void bench_rawmidi(unsigned int count, int terse)
+{
+	snd_seq_t *seq;
+	snd_seq_client_info_t *cinfo;
+	snd_seq_port_subscribe_t *sub;
+	snd_seq_addr_t addr;
+	snd_rawmidi_t *in, *out;
+	struct pollfd *pfds;
+	struct op wr, rd;
+	unsigned char before[256] = { 0 };
+	unsigned char msg[] = { 0x90, 0x3c, 0x40 }, buf[16];
+	unsigned long long t0, t1, took;
+	unsigned int i;
+	int npfds, client, got, err;
+
+	/* a client of our own, to find and loop back the virtual one */
+	err = snd_seq_open(&seq, "default", SND_SEQ_OPEN_DUPLEX, 0);
+	check_snd("open sequencer", err);
+	snd_seq_client_info_alloca(&cinfo);
+	snd_seq_client_info_set_client(cinfo, -1);
+	while (snd_seq_query_next_client(seq, cinfo) >= 0)
+		before[snd_seq_client_info_get_client(cinfo) & 0xff] = 1;
+
+	err = snd_rawmidi_open(&in, &out, "virtual", SND_RAWMIDI_NONBLOCK);
+	check_snd("open virtual rawmidi", err);
+	client = find_new_client(seq, before);
+	if (client < 0)
+		fatal("cannot find the virtual rawmidi client");
+	addr.client = client;
+	addr.port = 0;
+	snd_seq_port_subscribe_alloca(&sub);
+	snd_seq_port_subscribe_set_sender(sub, &addr);
+	snd_seq_port_subscribe_set_dest(sub, &addr);
+	err = snd_seq_subscribe_port(seq, sub);
+	check_snd("loop back the virtual rawmidi port", err);
+
+	npfds = snd_rawmidi_poll_descriptors_count(in);
+	pfds = calloc(npfds, sizeof(*pfds));
+	check_mem(pfds);
+	err = snd_rawmidi_poll_descriptors(in, pfds, npfds);
+	check_snd("get poll descriptors", err);
+
+	op_init(&wr, "snd_rawmidi_write", count);
+	op_init(&rd, "snd_rawmidi_read", count);
+	for (i = 0; i < count; ++i) {
+		t0 = now_ns();
+		err = snd_rawmidi_write(out, msg, sizeof(msg));
+		t1 = now_ns();
+		check_snd("write rawmidi", err);
+		op_add(&wr, t0, t1);
+
+		/* only the reads that return data count */
+		for (got = 0, took = 0; got < (int)sizeof(msg); ) {
+			if (poll(pfds, npfds, POLL_TIMEOUT) <= 0)
+				fatal("the virtual rawmidi loopback does not deliver");
+			t0 = now_ns();
+			err = snd_rawmidi_read(in, buf, sizeof(buf));
+			t1 = now_ns();
+			if (err == -EAGAIN)
+				continue;
+			check_snd("read rawmidi", err);
+			got += err;
+			took += t1 - t0;
+		}
+		op_add(&rd, 0, took);
+		msg[0] ^= 1; // prevent running status
+	}
+	print_header("virtual rawmidi, port to itself", terse);
+	op_report(&wr, terse);
+	op_report(&rd, terse);
+	free(pfds);
+	snd_rawmidi_close(in);
+	snd_rawmidi_close(out);
+	snd_seq_close(seq);
+}
+
+static void usage(const char *argv0)
+{
+	printf("Usage: %s [-S samples] [-t]\n\n"
+	       "  -S, --samples=#            calls to time per operation (default: 100000)\n"
+	       "  -t, --terse                CSV output: op,n,mean,stddev,min,median,99%%,max\n"
+	       "  -h, --help                 this help\n"
+	       "\n", argv0);
+}
+
+int main(int argc, char *argv[])
+{
+	static char short_options[] = "hS:t";
+	static struct option long_options[] = {
+		{"help", 0, NULL, 'h'},
+		{"samples", 1, NULL, 'S'},
+		{"terse", 0, NULL, 't'},
+		{}
+	};
+	int count = 100000;
+	int terse = 0;
+	int c;
+
+	while ((c = getopt_long(argc, argv, short_options,
+				long_options, NULL)) != -1) {
+		switch (c) {
+		case 'S':
+			count = atoi(optarg);
+			if (count < 1)
+				fatal("need at least one sample");
+			break;
+		case 't':
+			terse = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (!terse)
+		printf("> %s %s: %d calls per operation, timer overhead subtracted\n",
+		       PACKAGE, VERSION, count);
+	bench_clock(count, terse);
+	if (!terse)
+		printf("  (timer overhead: %u ns)\n", timer_overhead);
+	bench_seq(count, terse);
+	bench_rawmidi(count, terse);
+	return EXIT_SUCCESS;
+}
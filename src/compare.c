@@ -0,0 +1,224 @@
+/*
+ * compare.c - compare a run against a saved baseline
+ *
+ * Copyright (C) 2009 - 2026 Jakob Flierl <jakob.flierl@gmail.com>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "compare.h"
+
+#define SAMPLES_HEADER "# alsa-midi-latency-test samples, ns"
+
+int save_samples(const char *path, const unsigned int *delays, unsigned int n)
+{
+	FILE *f = fopen(path, "w");
+	unsigned int i;
+
+	if (!f)
+		return -1;
+	fprintf(f, "%s\n", SAMPLES_HEADER);
+	for (i = 0; i < n; ++i)
+		fprintf(f, "%u\n", delays[i]);
+	if (fclose(f))
+		return -1;
+	return 0;
+}
+
+unsigned int *load_samples(const char *path, unsigned int *n)
+{
+	FILE *f = fopen(path, "r");
+	unsigned int *delays = NULL, *p;
+	unsigned int size = 0, value;
+	char line[64];
+
+	if (!f)
+		return NULL;
+	*n = 0;
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%u", &value) != 1)
+			continue;
+		if (*n == size) {
+			size = size ? size * 2 : 1024;
+			p = realloc(delays, size * sizeof(*delays));
+			if (!p) {
+				free(delays);
+				fclose(f);
+				return NULL;
+			}
+			delays = p;
+		}
+		delays[(*n)++] = value;
+	}
+	fclose(f);
+	if (!*n) {
+		free(delays);
+		errno = EINVAL;
+		return NULL;
+	}
+	return delays;
+}
+
+/* asymptotic distribution of the KS statistic, as in Numerical Recipes */
+static double ks_probability(double lambda)
+{
+	double sum = 0, term, sign = 1;
+	int j;
+
+	if (lambda < 0.2)
+		return 1;
+	for (j = 1; j <= 100; ++j) {
+		term = sign * 2 * exp(-2 * j * j * lambda * lambda);
+		sum += term;
+		if (fabs(term) < 1e-10 * fabs(sum))
+			break;
+		sign = -sign;
+	}
+	if (sum < 0)
+		return 0;
+	return sum > 1 ? 1 : sum;
+}
+
+double ks_test(const unsigned int *a, unsigned int na,
+	       const unsigned int *b, unsigned int nb, double *p)
+{
+	unsigned int i = 0, j = 0, value;
+	double d = 0, diff, en;
+
+	while (i < na && j < nb) {
+		value = a[i] < b[j] ? a[i] : b[j];
+		while (i < na && a[i] == value)
+			i++;
+		while (j < nb && b[j] == value)
+			j++;
+		diff = fabs((double)i / na - (double)j / nb);
+		if (diff > d)
+			d = diff;
+	}
+	en = sqrt((double)na * nb / (na + nb));
+	*p = ks_probability((en + 0.12 + 0.11 / en) * d);
+	return d;
+}
+
+/*
+ * returns z, positive when the values in a tend to be larger than
+ * those in b; ties get their mean rank and correct the variance
+ */
+double mann_whitney(const unsigned int *a, unsigned int na,
+		    const unsigned int *b, unsigned int nb, double *p)
+{
+	unsigned int i = 0, j = 0, ta, tb, value;
+	double rank = 1, rank_sum = 0, ties = 0, t, n = (double)na + nb;
+	double u, mean, var, z;
+
+	while (i < na || j < nb) {
+		if (j == nb || (i < na && a[i] <= b[j]))
+			value = a[i];
+		else
+			value = b[j];
+		for (ta = 0; i < na && a[i] == value; ++i)
+			ta++;
+		for (tb = 0; j < nb && b[j] == value; ++j)
+			tb++;
+		t = ta + tb;
+		rank_sum += ta * (rank + (t - 1) / 2);
+		ties += t * t * t - t;
+		rank += t;
+	}
+	u = rank_sum - (double)na * (na + 1) / 2;
+	mean = (double)na * nb / 2;
+	var = (double)na * nb / 12 * ((n + 1) - ties / (n * (n - 1)));
+	if (var <= 0) {
+		*p = 1;
+		return 0;
+	}
+	z = (u - mean) / sqrt(var);
+	*p = erfc(fabs(z) / sqrt(2));
+	return z;
+}
+
+/*
+ * distribution-free 95% confidence interval of the q-th quantile: the
+ * order statistics around rank n*q, from the normal approximation of
+ * the binomial
+ */
+void quantile_ci(const unsigned int *sorted, unsigned int n, double q,
+		 unsigned int *value, unsigned int *lo, unsigned int *hi)
+{
+	double center = n * q, width = 1.96 * sqrt(n * q * (1 - q));
+	long rank = center + 0.5, l = floor(center - width), h = ceil(center + width);
+
+	if (rank < 1)
+		rank = 1;
+	if (rank > n)
+		rank = n;
+	if (l < 1)
+		l = 1;
+	if (h > n)
+		h = n;
+	*value = sorted[rank - 1];
+	*lo = sorted[l - 1];
+	*hi = sorted[h - 1];
+}
+
+int compare_samples(const unsigned int *cur, unsigned int ncur,
+		    const unsigned int *base, unsigned int nbase,
+		    double max_regression, double alpha, FILE *out)
+{
+	static const double points[] = { 50, 90, 99, 99.9 };
+	unsigned int i, v_cur, lo_cur, hi_cur, v_base, lo_base, hi_base;
+	unsigned int n = ncur < nbase ? ncur : nbase;
+	long long delta, delta_lo, delta_hi;
+	double d, p_ks, z, p_mw, limit;
+	int regressed = 0, worse;
+
+	d = ks_test(cur, ncur, base, nbase, &p_ks);
+	z = mann_whitney(cur, ncur, base, nbase, &p_mw);
+	fprintf(out, "\n> comparison with the baseline (%u samples):\n", nbase);
+	fprintf(out, "  Kolmogorov-Smirnov D = %.4f, p = %.4g\n", d, p_ks);
+	fprintf(out, "  Mann-Whitney       z = %+.2f, p = %.4g (%s)\n", z, p_mw,
+		p_mw >= alpha ? "no shift" : z > 0 ? "slower" : "faster");
+	fprintf(out, "\n  percentile  baseline_ms   current_ms     delta_ms  bounds of 95%% CIs\n");
+	for (i = 0; i < sizeof(points) / sizeof(*points); ++i) {
+		/* too few samples beyond the percentile to say anything */
+		if (n * (1 - points[i] / 100) < 5)
+			continue;
+		quantile_ci(cur, ncur, points[i] / 100, &v_cur, &lo_cur, &hi_cur);
+		quantile_ci(base, nbase, points[i] / 100, &v_base, &lo_base, &hi_base);
+		delta = (long long)v_cur - v_base;
+		/*
+		 * the farthest apart the two intervals allow; not itself a
+		 * 95% interval of the change, but a wider, conservative one
+		 */
+		delta_lo = (long long)lo_cur - hi_base;
+		delta_hi = (long long)hi_cur - lo_base;
+		limit = v_base * max_regression / 100;
+		worse = p_ks < alpha && delta_lo > limit;
+		if (worse)
+			regressed = 1;
+		fprintf(out, "  %10.1f %12.3f %12.3f %+12.3f [%+8.3f, %+8.3f]%s\n",
+			points[i], v_base / 1000000.0, v_cur / 1000000.0,
+			delta / 1000000.0, delta_lo / 1000000.0, delta_hi / 1000000.0,
+			worse ? "  REGRESSION" : "");
+	}
+	return regressed;
+}
@@ -0,0 +1,58 @@
+/*
+ * compare.h - compare a run against a saved baseline
+ *
+ * Copyright (C) 2009 - 2026 Jakob Flierl <jakob.flierl@gmail.com>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+#ifndef COMPARE_H
+#define COMPARE_H
+
+#include <stdio.h>
+
+/* latencies in nanoseconds, one per line; returns 0 or -1 with errno */
+int save_samples(const char *path, const unsigned int *delays, unsigned int n);
+/* returns a malloc'd array, or NULL with errno set */
+unsigned int *load_samples(const char *path, unsigned int *n);
+
+/*
+ * two-sample Kolmogorov-Smirnov and Mann-Whitney U tests, with the
+ * asymptotic p-values; both expect sorted input
+ */
+double ks_test(const unsigned int *a, unsigned int na,
+	       const unsigned int *b, unsigned int nb, double *p);
+double mann_whitney(const unsigned int *a, unsigned int na,
+		    const unsigned int *b, unsigned int nb, double *p);
+
+/*
+ * the q-th quantile (0 < q < 1) of n sorted values and the bounds of
+ * its distribution-free 95% confidence interval
+ */
+void quantile_ci(const unsigned int *sorted, unsigned int n, double q,
+		 unsigned int *value, unsigned int *lo, unsigned int *hi);
+
+/*
+ * compares the sorted samples against the sorted baseline: prints the
+ * test results and each percentile with the bounds its change can take
+ * within the 95% confidence intervals of both, and returns 1 if a
+ * percentile got worse by more than max_regression percent even at the
+ * lower bound, and the distributions differ at significance level alpha
+ */
+int compare_samples(const unsigned int *cur, unsigned int ncur,
+		    const unsigned int *base, unsigned int nbase,
+		    double max_regression, double alpha, FILE *out);
+
+#endif /* COMPARE_H */
@@ -0,0 +1,453 @@
+/*
+ * forensics.c - capture system context around latency outliers
+ *
+ * Copyright (C) 2009 - 2026 Jakob Flierl <jakob.flierl@gmail.com>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "forensics.h"
+
+#define TOP_IRQS 4
+
+struct irq_line {
+	char name[16];
+	char desc[40];
+	unsigned long long *counts;	/* per CPU */
+};
+
+struct snapshot {
+	unsigned long long time_ns;
+	int cpu;
+	int ncpu;
+	int nirq;
+	int irq_alloc;
+	struct irq_line *irqs;
+	unsigned long long ctxt;
+	unsigned int procs_running;
+	unsigned int procs_blocked;
+	unsigned long long nr_switches;
+	unsigned long long nr_voluntary;
+	unsigned long long nr_involuntary;
+	unsigned long long nr_migrations;
+	struct rusage ru;
+};
+
+struct record {
+	unsigned int sample_nr;
+	unsigned int delay_ns;
+	const char *reason;
+	int cpu;
+	double window_ms;
+	unsigned long long ctxt;
+	unsigned int procs_running;
+	unsigned int procs_blocked;
+	unsigned long long nr_switches;
+	unsigned long long nr_voluntary;
+	unsigned long long nr_involuntary;
+	unsigned long long nr_migrations;
+	long minflt, majflt;
+	int ncpu;
+	unsigned long long *cpu_irqs;	/* per CPU, all lines */
+	int ntop;
+	struct {
+		char name[16];
+		char desc[40];
+		unsigned long long total;
+		int top_cpu;
+		unsigned long long top_count;
+	} top[TOP_IRQS];
+};
+
+struct forensics {
+	unsigned int max_records;
+	unsigned int nr_records;
+	struct record *records;
+	unsigned long long refresh_ns;
+	struct snapshot snap[2];
+	int baseline;			/* index into snap[] */
+};
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* returns ENOMEM if out of memory; a missing file is no error */
+static int read_interrupts(struct snapshot *s)
+{
+	struct irq_line *irqs;
+	char line[4096];
+	char *p, *end;
+	FILE *f;
+	int i;
+
+	s->nirq = 0;
+	f = fopen("/proc/interrupts", "r");
+	if (!f)
+		return 0;
+	if (!fgets(line, sizeof(line), f)) {
+		fclose(f);
+		return 0;
+	}
+	/* the header has one "CPUn" column per online CPU */
+	if (!s->ncpu)
+		for (p = line; (p = strstr(p, "CPU")); p += 3)
+			s->ncpu++;
+
+	while (fgets(line, sizeof(line), f)) {
+		struct irq_line *irq;
+
+		p = line;
+		while (isspace((unsigned char)*p))
+			++p;
+		end = strchr(p, ':');
+		if (!end)
+			continue;
+		if (s->nirq == s->irq_alloc) {
+			i = s->irq_alloc ? s->irq_alloc * 2 : 64;
+			irqs = realloc(s->irqs, i * sizeof(*s->irqs));
+			if (!irqs) {
+				fclose(f);
+				return ENOMEM;
+			}
+			s->irqs = irqs;
+			for (; s->irq_alloc < i; ++s->irq_alloc)
+				s->irqs[s->irq_alloc].counts = NULL;
+		}
+		irq = &s->irqs[s->nirq];
+		if (!irq->counts) {
+			irq->counts = calloc(s->ncpu ? s->ncpu : 1, sizeof(*irq->counts));
+			if (!irq->counts) {
+				fclose(f);
+				return ENOMEM;
+			}
+		}
+		s->nirq++;
+		snprintf(irq->name, sizeof(irq->name), "%.*s", (int)(end - p), p);
+		p = end + 1;
+		for (i = 0; i < s->ncpu; ++i) {
+			irq->counts[i] = strtoull(p, &end, 10);
+			if (end == p)
+				break;	/* ERR, MIS: a single total */
+			p = end;
+		}
+		for (; i < s->ncpu; ++i)
+			irq->counts[i] = 0;
+		while (isspace((unsigned char)*p))
+			++p;
+		end = p + strlen(p);
+		while (end > p && isspace((unsigned char)end[-1]))
+			*--end = '\0';
+		/* the device name(s) come last; keep the tail if too long */
+		if (strlen(p) >= sizeof(irq->desc))
+			p = end - (sizeof(irq->desc) - 1);
+		snprintf(irq->desc, sizeof(irq->desc), "%s", p);
+	}
+	fclose(f);
+	return 0;
+}
+
+static void read_stat(struct snapshot *s)
+{
+	char line[256];
+	FILE *f;
+
+	f = fopen("/proc/stat", "r");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "ctxt %llu", &s->ctxt) == 1)
+			continue;
+		if (sscanf(line, "procs_running %u", &s->procs_running) == 1)
+			continue;
+		sscanf(line, "procs_blocked %u", &s->procs_blocked);
+	}
+	fclose(f);
+}
+
+static void read_sched(struct snapshot *s)
+{
+	char line[256];
+	char *colon, *end;
+	FILE *f;
+
+	f = fopen("/proc/self/sched", "r");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		colon = strchr(line, ':');
+		if (!colon)
+			continue;
+		end = colon;
+		while (end > line && isspace((unsigned char)end[-1]))
+			--end;
+		*end = '\0';
+		if (!strcmp(line, "nr_switches"))
+			s->nr_switches = strtoull(colon + 1, NULL, 10);
+		else if (!strcmp(line, "nr_voluntary_switches"))
+			s->nr_voluntary = strtoull(colon + 1, NULL, 10);
+		else if (!strcmp(line, "nr_involuntary_switches"))
+			s->nr_involuntary = strtoull(colon + 1, NULL, 10);
+		else if (!strcmp(line, "se.nr_migrations"))
+			s->nr_migrations = strtoull(colon + 1, NULL, 10);
+	}
+	fclose(f);
+}
+
+static int take_snapshot(struct snapshot *s)
+{
+	s->time_ns = now_ns();
+	s->cpu = sched_getcpu();
+	getrusage(RUSAGE_THREAD, &s->ru);
+	read_stat(s);
+	read_sched(s);
+	return read_interrupts(s);
+}
+
+static const struct irq_line *find_irq(const struct snapshot *s,
+				       const char *name, int hint)
+{
+	int i;
+
+	if (hint < s->nirq && !strcmp(s->irqs[hint].name, name))
+		return &s->irqs[hint];
+	for (i = 0; i < s->nirq; ++i)
+		if (!strcmp(s->irqs[i].name, name))
+			return &s->irqs[i];
+	return NULL;
+}
+
+/* cpu_irqs has room for b->ncpu counts, and becomes the record's */
+static void diff_interrupts(struct record *r, const struct snapshot *a,
+			    const struct snapshot *b, unsigned long long *cpu_irqs)
+{
+	const struct irq_line *old;
+	unsigned long long total, top_count, d;
+	int i, c, k, top_cpu;
+
+	r->ncpu = b->ncpu;
+	r->cpu_irqs = cpu_irqs;
+	r->ntop = 0;
+	for (i = 0; i < b->nirq; ++i) {
+		old = find_irq(a, b->irqs[i].name, i);
+		total = top_count = 0;
+		top_cpu = 0;
+		for (c = 0; c < b->ncpu; ++c) {
+			d = b->irqs[i].counts[c];
+			if (old && c < a->ncpu && d >= old->counts[c])
+				d -= old->counts[c];
+			else if (old)
+				d = 0;
+			r->cpu_irqs[c] += d;
+			total += d;
+			if (d > top_count) {
+				top_count = d;
+				top_cpu = c;
+			}
+		}
+		if (!total)
+			continue;
+		/* insertion into the busiest few */
+		for (k = r->ntop; k > 0 && r->top[k - 1].total < total; --k)
+			if (k < TOP_IRQS)
+				r->top[k] = r->top[k - 1];
+		if (k >= TOP_IRQS)
+			continue;
+		snprintf(r->top[k].name, sizeof(r->top[k].name), "%s", b->irqs[i].name);
+		snprintf(r->top[k].desc, sizeof(r->top[k].desc), "%s", b->irqs[i].desc);
+		r->top[k].total = total;
+		r->top[k].top_cpu = top_cpu;
+		r->top[k].top_count = top_count;
+		if (r->ntop < TOP_IRQS)
+			r->ntop++;
+	}
+}
+
+struct forensics *forensics_new(unsigned int max_records,
+				unsigned int refresh_ms)
+{
+	struct forensics *f = calloc(1, sizeof(*f));
+
+	if (!f)
+		return NULL;
+	f->max_records = max_records;
+	f->records = calloc(max_records, sizeof(*f->records));
+	if (!f->records) {
+		free(f);
+		return NULL;
+	}
+	f->refresh_ns = refresh_ms * 1000000ULL;
+	if (take_snapshot(&f->snap[f->baseline])) {
+		forensics_free(f);
+		errno = ENOMEM;
+		return NULL;
+	}
+	return f;
+}
+
+void forensics_free(struct forensics *f)
+{
+	unsigned int i;
+	int k, j;
+
+	if (!f)
+		return;
+	for (i = 0; i < f->nr_records; ++i)
+		free(f->records[i].cpu_irqs);
+	for (k = 0; k < 2; ++k) {
+		for (j = 0; j < f->snap[k].irq_alloc; ++j)
+			free(f->snap[k].irqs[j].counts);
+		free(f->snap[k].irqs);
+	}
+	free(f->records);
+	free(f);
+}
+
+int forensics_tick(struct forensics *f)
+{
+	if (now_ns() - f->snap[f->baseline].time_ns >= f->refresh_ns)
+		return take_snapshot(&f->snap[f->baseline]);
+	return 0;
+}
+
+int forensics_capture(struct forensics *f, unsigned int sample_nr,
+		      unsigned int delay_ns, const char *reason)
+{
+	const struct snapshot *a = &f->snap[f->baseline];
+	struct snapshot *b = &f->snap[!f->baseline];
+	unsigned long long *cpu_irqs;
+	struct record *r;
+	unsigned int i;
+
+	if (f->nr_records < f->max_records) {
+		r = &f->records[f->nr_records];
+	} else {
+		/* full: replace the mildest record, if this one is worse */
+		r = &f->records[0];
+		for (i = 1; i < f->nr_records; ++i)
+			if (f->records[i].delay_ns < r->delay_ns)
+				r = &f->records[i];
+		if (delay_ns <= r->delay_ns)
+			return 0;
+	}
+
+	/* allocate before touching the record, so that it stays intact */
+	b->ncpu = a->ncpu;
+	if (take_snapshot(b))
+		return ENOMEM;
+	cpu_irqs = calloc(b->ncpu ? b->ncpu : 1, sizeof(*cpu_irqs));
+	if (!cpu_irqs)
+		return ENOMEM;
+	if (r == &f->records[f->nr_records])
+		f->nr_records++;
+	else
+		free(r->cpu_irqs);
+	r->sample_nr = sample_nr;
+	r->delay_ns = delay_ns;
+	r->reason = reason;
+	r->cpu = b->cpu;
+	r->window_ms = (b->time_ns - a->time_ns) / 1000000.0;
+	r->ctxt = b->ctxt - a->ctxt;
+	r->procs_running = b->procs_running;
+	r->procs_blocked = b->procs_blocked;
+	r->nr_switches = b->nr_switches - a->nr_switches;
+	r->nr_voluntary = b->nr_voluntary - a->nr_voluntary;
+	r->nr_involuntary = b->nr_involuntary - a->nr_involuntary;
+	r->nr_migrations = b->nr_migrations - a->nr_migrations;
+	r->minflt = b->ru.ru_minflt - a->ru.ru_minflt;
+	r->majflt = b->ru.ru_majflt - a->ru.ru_majflt;
+	diff_interrupts(r, a, b, cpu_irqs);
+
+	/* the next capture is relative to this one */
+	f->baseline = !f->baseline;
+	return 0;
+}
+
+void forensics_drop_before(struct forensics *f, unsigned int sample_nr)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; i < f->nr_records; ++i) {
+		if (f->records[i].sample_nr < sample_nr)
+			free(f->records[i].cpu_irqs);
+		else
+			f->records[n++] = f->records[i];
+	}
+	f->nr_records = n;
+}
+
+static int compare_records(const void *p1, const void *p2)
+{
+	const struct record *a = *(const struct record * const *)p1;
+	const struct record *b = *(const struct record * const *)p2;
+
+	return a->delay_ns < b->delay_ns ? 1 : a->delay_ns > b->delay_ns ? -1 : 0;
+}
+
+void forensics_report(const struct forensics *f, FILE *out)
+{
+	const struct record **sorted;
+	const struct record *r;
+	unsigned int i;
+	int c, k;
+
+	if (!f->nr_records)
+		return;
+	sorted = malloc(f->nr_records * sizeof(*sorted));
+	if (!sorted)
+		return;
+	for (i = 0; i < f->nr_records; ++i)
+		sorted[i] = &f->records[i];
+	qsort(sorted, f->nr_records, sizeof(*sorted), compare_records);
+
+	fprintf(out, "\n> outlier forensics (worst %u, deltas since the previous snapshot):\n",
+		f->nr_records);
+	for (i = 0; i < f->nr_records; ++i) {
+		r = sorted[i];
+		fprintf(out, "\n sample %u: %.3f ms (%s) on CPU %d, window %.1f ms\n",
+			r->sample_nr, r->delay_ns / 1000000.0, r->reason,
+			r->cpu, r->window_ms);
+		fprintf(out, "  context switches: %llu system-wide, %llu of this thread"
+			" (%llu voluntary, %llu involuntary), %llu migrations\n",
+			r->ctxt, r->nr_switches, r->nr_voluntary,
+			r->nr_involuntary, r->nr_migrations);
+		fprintf(out, "  run queue: %u running, %u blocked; page faults: %ld minor, %ld major\n",
+			r->procs_running, r->procs_blocked, r->minflt, r->majflt);
+		fprintf(out, "  interrupts per CPU:");
+		for (c = 0; c < r->ncpu; ++c)
+			fprintf(out, " %llu", r->cpu_irqs[c]);
+		fputc('\n', out);
+		for (k = 0; k < r->ntop; ++k)
+			fprintf(out, "  %8llu x IRQ %-5s %-39s mostly on CPU %d (%llu)\n",
+				r->top[k].total, r->top[k].name, r->top[k].desc,
+				r->top[k].top_cpu, r->top[k].top_count);
+	}
+	free(sorted);
+}
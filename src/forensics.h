@@ -0,0 +1,54 @@
+/*
+ * forensics.h - capture system context around latency outliers
+ *
+ * Copyright (C) 2009 - 2026 Jakob Flierl <jakob.flierl@gmail.com>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+#ifndef FORENSICS_H
+#define FORENSICS_H
+
+#include <stdio.h>
+
+struct forensics;
+
+/*
+ * keeps a baseline snapshot of /proc/interrupts, /proc/stat,
+ * /proc/self/sched and the thread's rusage, refreshed at most every
+ * refresh_ms by forensics_tick().  forensics_capture() diffs a fresh
+ * snapshot against it; only the max_records worst captures are kept.
+ */
+struct forensics *forensics_new(unsigned int max_records,
+				unsigned int refresh_ms);
+void forensics_free(struct forensics *f);
+
+/*
+ * forensics_new() returns NULL and the other two ENOMEM when out of
+ * memory; a failed capture leaves the records as they were
+ */
+
+/* call between samples; cheap unless the baseline is due */
+int forensics_tick(struct forensics *f);
+
+int forensics_capture(struct forensics *f, unsigned int sample_nr,
+		      unsigned int delay_ns, const char *reason);
+
+/* forgets the captures of samples before sample_nr, e.g. warm-up */
+void forensics_drop_before(struct forensics *f, unsigned int sample_nr);
+
+void forensics_report(const struct forensics *f, FILE *out);
+
+#endif /* FORENSICS_H */
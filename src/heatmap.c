@@ -0,0 +1,277 @@
+/*
+ * heatmap.c - time by latency heatmaps of a run
+ *
+ * Copyright (C) 2009 - 2026 Jakob Flierl <jakob.flierl@gmail.com>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "heatmap.h"
+
+/* two rows per power of two, from 8 us up to about 8 s */
+#define HEATMAP_ROWS 40
+#define HEATMAP_FIRST_NS 8000.0
+#define HEATMAP_COLS 512
+#define HEATMAP_FIRST_BIN_NS 1000000ULL
+
+/* SVG cell size and margins, in pixels */
+#define SVG_CELL_W 2
+#define SVG_CELL_H 10
+#define SVG_LEFT 80
+#define SVG_TOP 30
+#define SVG_BOTTOM 50
+
+struct heatmap {
+	int started;
+	unsigned long long start_ns;
+	unsigned long long bin_ns;
+	unsigned int cols;		/* in use */
+	unsigned int cells[HEATMAP_COLS][HEATMAP_ROWS];
+	unsigned int lost[HEATMAP_COLS];
+};
+
+/* the xterm 256-color cube, from dark blue over green to yellow */
+static const unsigned char ansi_ramp[] = {
+	17, 18, 19, 20, 26, 32, 38, 37, 36, 35, 71, 107, 143, 179, 220, 226
+};
+
+/* viridis, for the SVG */
+static const unsigned char svg_ramp[][3] = {
+	{ 68, 1, 84 }, { 59, 82, 139 }, { 33, 145, 140 },
+	{ 94, 201, 98 }, { 253, 231, 37 }
+};
+
+static unsigned int row_of(unsigned int delay_ns)
+{
+	int r;
+
+	if (delay_ns <= HEATMAP_FIRST_NS)
+		return 0;
+	r = 2 * log2(delay_ns / HEATMAP_FIRST_NS);
+	return r < HEATMAP_ROWS ? r : HEATMAP_ROWS - 1;
+}
+
+static double row_low_ms(unsigned int r)
+{
+	return HEATMAP_FIRST_NS * pow(2, r / 2.0) / 1000000.0;
+}
+
+struct heatmap *heatmap_new(void)
+{
+	struct heatmap *h = calloc(1, sizeof(*h));
+
+	if (h)
+		h->bin_ns = HEATMAP_FIRST_BIN_NS;
+	return h;
+}
+
+void heatmap_free(struct heatmap *h)
+{
+	free(h);
+}
+
+/* halves the number of columns by merging neighbours */
+static void coalesce(struct heatmap *h)
+{
+	unsigned int c, r;
+
+	for (c = 0; c < h->cols; ++c) {
+		if (c % 2 == 0) {
+			memcpy(h->cells[c / 2], h->cells[c], sizeof(h->cells[c]));
+			h->lost[c / 2] = h->lost[c];
+		} else {
+			for (r = 0; r < HEATMAP_ROWS; ++r)
+				h->cells[c / 2][r] += h->cells[c][r];
+			h->lost[c / 2] += h->lost[c];
+		}
+	}
+	h->cols = (h->cols + 1) / 2;
+	memset(h->cells[h->cols], 0, (HEATMAP_COLS - h->cols) * sizeof(h->cells[0]));
+	memset(h->lost + h->cols, 0, (HEATMAP_COLS - h->cols) * sizeof(h->lost[0]));
+	h->bin_ns *= 2;
+}
+
+static unsigned int column_of(struct heatmap *h, unsigned long long t_ns)
+{
+	unsigned long long c;
+
+	if (!h->started) {
+		h->start_ns = t_ns;
+		h->started = 1;
+	}
+	if (t_ns < h->start_ns)
+		t_ns = h->start_ns;
+	while ((c = (t_ns - h->start_ns) / h->bin_ns) >= HEATMAP_COLS)
+		coalesce(h);
+	if (c >= h->cols)
+		h->cols = c + 1;
+	return c;
+}
+
+void heatmap_add(struct heatmap *h, unsigned long long t_ns, unsigned int delay_ns)
+{
+	h->cells[column_of(h, t_ns)][row_of(delay_ns)]++;
+}
+
+void heatmap_lost(struct heatmap *h, unsigned long long t_ns)
+{
+	h->lost[column_of(h, t_ns)]++;
+}
+
+/* the rows that hold samples, and the fullest cell of groups of columns */
+static int extent(const struct heatmap *h, unsigned int group,
+		  int *rlo, int *rhi, unsigned int *max)
+{
+	unsigned int c, r, sum;
+
+	*rlo = HEATMAP_ROWS;
+	*rhi = -1;
+	*max = 0;
+	for (r = 0; r < HEATMAP_ROWS; ++r) {
+		for (c = 0; c < h->cols; c += group) {
+			unsigned int i;
+
+			for (i = sum = 0; i < group && c + i < h->cols; ++i)
+				sum += h->cells[c + i][r];
+			if (!sum)
+				continue;
+			if ((int)r < *rlo)
+				*rlo = r;
+			*rhi = r;
+			if (sum > *max)
+				*max = sum;
+		}
+	}
+	return *rhi >= 0;
+}
+
+/* 0 .. 1 on a log scale, so that rare outliers still show */
+static double shade(unsigned int count, unsigned int max)
+{
+	return max > 1 ? log(count) / log(max) : 1;
+}
+
+void heatmap_print(const struct heatmap *h, FILE *out, unsigned int width)
+{
+	unsigned int group, c, i, sum, lost, max;
+	int r, rlo, rhi;
+
+	if (!width)
+		width = 1;
+	group = (h->cols + width - 1) / width;
+	if (!group || !extent(h, group, &rlo, &rhi, &max)) {
+		fputs("  (no samples)\n", out);
+		return;
+	}
+	for (r = rhi; r >= rlo; --r) {
+		fprintf(out, "%9.3f ms |", row_low_ms(r));
+		for (c = 0; c < h->cols; c += group) {
+			for (i = sum = 0; i < group && c + i < h->cols; ++i)
+				sum += h->cells[c + i][r];
+			if (sum)
+				fprintf(out, "\033[48;5;%dm \033[0m",
+					ansi_ramp[(int)(shade(sum, max) * (sizeof(ansi_ramp) - 1) + 0.5)]);
+			else
+				fputc(' ', out);
+		}
+		fputc('\n', out);
+	}
+	fprintf(out, "%12s |", "lost");
+	for (c = 0; c < h->cols; c += group) {
+		for (i = lost = 0; i < group && c + i < h->cols; ++i)
+			lost += h->lost[c + i];
+		fputs(lost ? "\033[1;31mx\033[0m" : " ", out);
+	}
+	fprintf(out, "\n%12s +", "");
+	for (c = 0; c < h->cols; c += group)
+		fputc('-', out);
+	fprintf(out, "\n%12s  0 s .. %.3f s, %.3f s per column, 1 .. %u samples per cell\n",
+		"", h->cols * h->bin_ns / 1e9, group * h->bin_ns / 1e9, max);
+}
+
+static void svg_color(double f, unsigned char rgb[3])
+{
+	int n = sizeof(svg_ramp) / sizeof(svg_ramp[0]) - 1, i, k;
+	double x = f * n;
+
+	i = x >= n ? n - 1 : (int)x;
+	x -= i;
+	for (k = 0; k < 3; ++k)
+		rgb[k] = svg_ramp[i][k] + (svg_ramp[i + 1][k] - svg_ramp[i][k]) * x + 0.5;
+}
+
+int heatmap_write_svg(const struct heatmap *h, const char *path)
+{
+	FILE *f = fopen(path, "w");
+	unsigned int c, max, width, height;
+	unsigned char rgb[3];
+	int r, rlo, rhi, y;
+
+	if (!f)
+		return -1;
+	if (!extent(h, 1, &rlo, &rhi, &max)) {
+		rlo = 0;
+		rhi = -1;
+	}
+	width = SVG_LEFT + h->cols * SVG_CELL_W + 20;
+	height = SVG_TOP + (rhi - rlo + 2) * SVG_CELL_H + SVG_BOTTOM;
+	fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	fprintf(f, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%u\" height=\"%u\" "
+		"font-family=\"sans-serif\" font-size=\"10\">\n", width, height);
+	fprintf(f, "<rect width=\"100%%\" height=\"100%%\" fill=\"white\"/>\n");
+	fprintf(f, "<text x=\"%d\" y=\"18\" font-size=\"12\">MIDI roundtrip latency over time"
+		" (%.3f s per column, up to %u samples per cell)</text>\n",
+		SVG_LEFT, h->bin_ns / 1e9, max);
+
+	for (r = rhi; r >= rlo; --r) {
+		y = SVG_TOP + (rhi - r) * SVG_CELL_H;
+		if (r % 2 == 0)
+			fprintf(f, "<text x=\"%d\" y=\"%d\" text-anchor=\"end\">%.3f ms</text>\n",
+				SVG_LEFT - 4, y + SVG_CELL_H, row_low_ms(r));
+		for (c = 0; c < h->cols; ++c) {
+			if (!h->cells[c][r])
+				continue;
+			svg_color(shade(h->cells[c][r], max), rgb);
+			fprintf(f, "<rect x=\"%u\" y=\"%d\" width=\"%d\" height=\"%d\" "
+				"fill=\"#%02x%02x%02x\"><title>%u</title></rect>\n",
+				SVG_LEFT + c * SVG_CELL_W, y, SVG_CELL_W, SVG_CELL_H,
+				rgb[0], rgb[1], rgb[2], h->cells[c][r]);
+		}
+	}
+
+	/* losses, in a strip of their own below the map */
+	y = SVG_TOP + (rhi - rlo + 1) * SVG_CELL_H;
+	fprintf(f, "<text x=\"%d\" y=\"%d\" text-anchor=\"end\" fill=\"red\">lost</text>\n",
+		SVG_LEFT - 4, y + SVG_CELL_H);
+	for (c = 0; c < h->cols; ++c)
+		if (h->lost[c])
+			fprintf(f, "<rect x=\"%u\" y=\"%d\" width=\"%d\" height=\"%d\" "
+				"fill=\"red\"><title>%u lost</title></rect>\n",
+				SVG_LEFT + c * SVG_CELL_W, y, SVG_CELL_W, SVG_CELL_H,
+				h->lost[c]);
+
+	y += SVG_CELL_H + 14;
+	fprintf(f, "<text x=\"%d\" y=\"%d\">0 s</text>\n", SVG_LEFT, y);
+	fprintf(f, "<text x=\"%u\" y=\"%d\" text-anchor=\"end\">%.3f s</text>\n",
+		SVG_LEFT + h->cols * SVG_CELL_W, y, h->cols * h->bin_ns / 1e9);
+	fprintf(f, "</svg>\n");
+	if (fclose(f))
+		return -1;
+	return 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * heatmap.h - time by latency heatmaps of a run
+ *
+ * Copyright (C) 2009 - 2026 Jakob Flierl <jakob.flierl@gmail.com>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <stdio.h>
+
+struct heatmap;
+
+/*
+ * counts samples by time and log-scale latency as they come in, in
+ * columns that start HEATMAP_FIRST_BIN_NS wide; when the columns run
+ * out, neighbours are merged and the width doubles, so that memory stays
+ * the same however long the run
+ */
+struct heatmap *heatmap_new(void);
+void heatmap_free(struct heatmap *h);
+
+/* t_ns is when the probe was sent, on any clock */
+void heatmap_add(struct heatmap *h, unsigned long long t_ns, unsigned int delay_ns);
+void heatmap_lost(struct heatmap *h, unsigned long long t_ns);
+
+/* 256-color ANSI rendering, at most width columns wide */
+void heatmap_print(const struct heatmap *h, FILE *out, unsigned int width);
+/* a standalone SVG image */
+int heatmap_write_svg(const struct heatmap *h, const char *path);
+
+#endif /* HEATMAP_H */
@@ -0,0 +1,271 @@
+/*
+ * histogram.c - mergeable log-scale latency histograms
+ *
+ * Copyright (C) 2009 - 2026 Jakob Flierl <jakob.flierl@gmail.com>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "histogram.h"
+
+#define SUMMARY_HEADER "# alsa-midi-latency-test histogram"
+#define CONFIG_SIZE 256
+
+struct histogram {
+	char config[CONFIG_SIZE];
+	unsigned long long fingerprint;
+	unsigned long long count;
+	unsigned long long lost;
+	unsigned long long sum;
+	unsigned int min;
+	unsigned int max;
+	unsigned long long buckets[HIST_BUCKETS];
+};
+
+static const double report_percentiles[] = { 50, 90, 99, 99.9, 99.99 };
+
+/* FNV-1a of the bucket layout and the configuration */
+static unsigned long long fingerprint(const char *config)
+{
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	const char *p;
+
+	hash = (hash ^ HIST_SUB_BITS) * 0x100000001b3ULL;
+	for (p = config; *p; ++p)
+		hash = (hash ^ (unsigned char)*p) * 0x100000001b3ULL;
+	return hash;
+}
+
+static unsigned int bucket_of(unsigned int v)
+{
+	int e;
+
+	if (v < HIST_SUB_BUCKETS)
+		return v;
+	e = 31 - __builtin_clz(v);
+	return (e - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS +
+	       ((v >> (e - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1));
+}
+
+static unsigned int bucket_low(unsigned int i)
+{
+	int e;
+
+	if (i < HIST_SUB_BUCKETS)
+		return i;
+	e = i / HIST_SUB_BUCKETS + HIST_SUB_BITS - 1;
+	return (HIST_SUB_BUCKETS + i % HIST_SUB_BUCKETS) << (e - HIST_SUB_BITS);
+}
+
+/* the highest value in bucket i */
+static unsigned int bucket_high(unsigned int i)
+{
+	if (i < HIST_SUB_BUCKETS)
+		return i;
+	if (i == HIST_BUCKETS - 1)
+		return UINT_MAX;
+	return bucket_low(i + 1) - 1;
+}
+
+struct histogram *histogram_new(const char *config)
+{
+	struct histogram *h = calloc(1, sizeof(*h));
+
+	if (!h)
+		return NULL;
+	snprintf(h->config, sizeof(h->config), "%s", config);
+	h->fingerprint = fingerprint(h->config);
+	h->min = UINT_MAX;
+	return h;
+}
+
+void histogram_free(struct histogram *h)
+{
+	free(h);
+}
+
+void histogram_add(struct histogram *h, unsigned int delay_ns)
+{
+	h->buckets[bucket_of(delay_ns)]++;
+	h->count++;
+	h->sum += delay_ns;
+	if (delay_ns < h->min)
+		h->min = delay_ns;
+	if (delay_ns > h->max)
+		h->max = delay_ns;
+}
+
+void histogram_lost(struct histogram *h)
+{
+	h->lost++;
+}
+
+int histogram_save(const struct histogram *h, const char *path)
+{
+	FILE *f = fopen(path, "w");
+	unsigned int i;
+
+	if (!f)
+		return -1;
+	fprintf(f, "%s, ns\n", SUMMARY_HEADER);
+	fprintf(f, "layout %d\n", HIST_SUB_BITS);
+	fprintf(f, "config %016llx %s\n", h->fingerprint, h->config);
+	fprintf(f, "count %llu\nlost %llu\nsum %llu\n", h->count, h->lost, h->sum);
+	if (h->count)
+		fprintf(f, "min %u\nmax %u\n", h->min, h->max);
+	for (i = 0; i < HIST_BUCKETS; ++i)
+		if (h->buckets[i])
+			fprintf(f, "bucket %u %llu\n", bucket_low(i), h->buckets[i]);
+	if (fclose(f))
+		return -1;
+	return 0;
+}
+
+struct histogram *histogram_load(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	struct histogram *h;
+	char line[CONFIG_SIZE + 64], *config;
+	unsigned long long n, fp;
+	unsigned int value;
+	int layout = -1, ok = 1;
+
+	if (!f)
+		return NULL;
+	h = histogram_new("");
+	if (!h) {
+		fclose(f);
+		return NULL;
+	}
+	while (ok && fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\n")] = '\0';
+		if (line[0] == '#' || !line[0])
+			continue;
+		if (sscanf(line, "layout %d", &layout) == 1)
+			ok = layout == HIST_SUB_BITS;
+		else if (sscanf(line, "config %llx", &fp) == 1) {
+			config = strchr(line + strlen("config "), ' ');
+			snprintf(h->config, sizeof(h->config), "%s", config ? config + 1 : "");
+			h->fingerprint = fingerprint(h->config);
+			ok = fp == h->fingerprint;
+		} else if (sscanf(line, "count %llu", &n) == 1)
+			h->count = n;
+		else if (sscanf(line, "lost %llu", &n) == 1)
+			h->lost = n;
+		else if (sscanf(line, "sum %llu", &n) == 1)
+			h->sum = n;
+		else if (sscanf(line, "min %u", &value) == 1)
+			h->min = value;
+		else if (sscanf(line, "max %u", &value) == 1)
+			h->max = value;
+		else if (sscanf(line, "bucket %u %llu", &value, &n) == 2)
+			h->buckets[bucket_of(value)] += n;
+		else
+			ok = 0;
+	}
+	fclose(f);
+	/* the buckets must add up, or the file was cut short */
+	for (n = 0, value = 0; value < HIST_BUCKETS; ++value)
+		n += h->buckets[value];
+	if (!ok || layout < 0 || n != h->count) {
+		free(h);
+		errno = EINVAL;
+		return NULL;
+	}
+	return h;
+}
+
+int histogram_merge(struct histogram *into, const struct histogram *h)
+{
+	unsigned int i;
+
+	if (into->fingerprint != h->fingerprint)
+		return -1;
+	for (i = 0; i < HIST_BUCKETS; ++i)
+		into->buckets[i] += h->buckets[i];
+	into->count += h->count;
+	into->lost += h->lost;
+	into->sum += h->sum;
+	if (h->min < into->min)
+		into->min = h->min;
+	if (h->max > into->max)
+		into->max = h->max;
+	return 0;
+}
+
+const char *histogram_config(const struct histogram *h)
+{
+	return h->config;
+}
+
+unsigned long long histogram_count(const struct histogram *h)
+{
+	return h->count;
+}
+
+void histogram_percentile(const struct histogram *h, double q,
+			  unsigned int *lo, unsigned int *hi)
+{
+	unsigned long long rank, seen = 0;
+	unsigned int i;
+
+	/* nearest rank, as everywhere else */
+	rank = (unsigned long long)(q / 100.0 * h->count + 0.999999);
+	if (rank < 1)
+		rank = 1;
+	for (i = 0; i < HIST_BUCKETS - 1; ++i) {
+		seen += h->buckets[i];
+		if (seen >= rank)
+			break;
+	}
+	/* the extremes are known exactly */
+	*lo = bucket_low(i) > h->min ? bucket_low(i) : h->min;
+	*hi = bucket_high(i) < h->max ? bucket_high(i) : h->max;
+}
+
+void histogram_report(const struct histogram *h, FILE *out, int terse)
+{
+	unsigned int lo, hi, i;
+
+	if (!h->count) {
+		fprintf(out, terse ? "0,%llu\n" : "> no samples, %llu lost\n", h->lost);
+		return;
+	}
+	if (terse) {
+		fprintf(out, "%llu,%llu,%u,%llu,%u", h->count, h->lost, h->min,
+			h->sum / h->count, h->max);
+		for (i = 0; i < sizeof(report_percentiles) / sizeof(*report_percentiles); ++i) {
+			histogram_percentile(h, report_percentiles[i], &lo, &hi);
+			fprintf(out, ",%u", hi);
+		}
+		fputc('\n', out);
+		return;
+	}
+	fprintf(out, "> %llu samples, %llu lost\n", h->count, h->lost);
+	fprintf(out, "  %-8s %10s\n", "", "ms");
+	fprintf(out, "  %-8s %10.3f\n", "min", h->min / 1000000.0);
+	fprintf(out, "  %-8s %10.3f\n", "mean", (double)h->sum / h->count / 1000000.0);
+	for (i = 0; i < sizeof(report_percentiles) / sizeof(*report_percentiles); ++i) {
+		histogram_percentile(h, report_percentiles[i], &lo, &hi);
+		fprintf(out, "  p%-7g %10.3f   (%.3f .. %.3f)\n", report_percentiles[i],
+			hi / 1000000.0, lo / 1000000.0, hi / 1000000.0);
+	}
+	fprintf(out, "  %-8s %10.3f\n", "max", h->max / 1000000.0);
+}
@@ -0,0 +1,64 @@
+/*
+ * histogram.h - mergeable log-scale latency histograms
+ *
+ * Copyright (C) 2009 - 2026 Jakob Flierl <jakob.flierl@gmail.com>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdio.h>
+
+/*
+ * HIST_SUB_BUCKETS buckets per power of two, so that a bucket is never
+ * wider than 1/HIST_SUB_BUCKETS of its lower bound; values below
+ * HIST_SUB_BUCKETS ns get a bucket each
+ */
+#define HIST_SUB_BITS 5
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((32 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+struct histogram;
+
+/* config describes the measurement; only like summaries can be merged */
+struct histogram *histogram_new(const char *config);
+void histogram_free(struct histogram *h);
+
+void histogram_add(struct histogram *h, unsigned int delay_ns);
+void histogram_lost(struct histogram *h);
+
+/*
+ * a summary is a small text file: the bucket layout, the configuration
+ * and its fingerprint, count, lost, min, max, sum and the non-empty
+ * buckets.  histogram_load() sets errno to EINVAL for a malformed file.
+ */
+int histogram_save(const struct histogram *h, const char *path);
+struct histogram *histogram_load(const char *path);
+
+/* adds h to into; fails if the configurations differ */
+int histogram_merge(struct histogram *into, const struct histogram *h);
+
+const char *histogram_config(const struct histogram *h);
+unsigned long long histogram_count(const struct histogram *h);
+
+/* the bounds of the bucket that holds the q-th percentile (0 < q <= 100) */
+void histogram_percentile(const struct histogram *h, double q,
+			  unsigned int *lo, unsigned int *hi);
+
+void histogram_report(const struct histogram *h, FILE *out, int terse);
+
+#endif /* HISTOGRAM_H */
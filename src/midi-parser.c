@@ -0,0 +1,150 @@
+/*
+ * midi-parser.c - incremental MIDI 1.0 byte stream parser
+ *
+ * Copyright (C) 2009 - 2026 Jakob Flierl <jakob.flierl@gmail.com>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+#include "midi-parser.h"
+
+int midi_data_length(unsigned char status)
+{
+	if (status < 0x80)
+		return 0;
+	switch (status & 0xf0) {
+	case 0xc0:
+	case 0xd0:
+		return 1;
+	case 0xf0:
+		break;
+	default:
+		return 2;
+	}
+	switch (status) {
+	case 0xf0:
+		return -1;
+	case 0xf1:
+	case 0xf3:
+		return 1;
+	case 0xf2:
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+void midi_parser_reset(struct midi_parser *p)
+{
+	p->running_status = 0;
+	p->status = 0;
+	p->pos = 0;
+	p->needed = 0;
+	p->in_sysex = 0;
+	p->sysex_len = 0;
+}
+
+void midi_parser_init(struct midi_parser *p,
+		      unsigned char *sysex_buf, size_t sysex_size)
+{
+	p->sysex_buf = sysex_buf;
+	p->sysex_size = sysex_buf ? sysex_size : 0;
+	midi_parser_reset(p);
+}
+
+static int complete(struct midi_parser *p, struct midi_message *msg)
+{
+	msg->status = p->status;
+	msg->data[0] = p->pos > 0 ? p->data[0] : 0;
+	msg->data[1] = p->pos > 1 ? p->data[1] : 0;
+	msg->length = 1 + p->needed;
+	p->pos = 0;
+	return 1;
+}
+
+int midi_parser_feed(struct midi_parser *p, unsigned char byte,
+		     struct midi_message *msg)
+{
+	int len;
+
+	if (byte >= 0xf8) {
+		/* realtime: may appear anywhere, even inside SysEx */
+		msg->status = byte;
+		msg->data[0] = msg->data[1] = 0;
+		msg->length = 1;
+		return 1;
+	}
+
+	if (p->in_sysex) {
+		if (byte < 0x80) {
+			if (p->sysex_len < p->sysex_size)
+				p->sysex_buf[p->sysex_len] = byte;
+			p->sysex_len++;
+			return 0;
+		}
+		p->in_sysex = 0;
+		if (byte == 0xf7) {
+			msg->status = 0xf0;
+			msg->data[0] = msg->data[1] = 0;
+			msg->length = p->sysex_len + 2;
+			return 1;
+		}
+		/* any other status byte aborts the SysEx and starts anew */
+	}
+
+	if (byte & 0x80) {
+		len = midi_data_length(byte);
+		p->pos = 0;
+		if (len < 0) {
+			p->in_sysex = 1;
+			p->sysex_len = 0;
+			p->running_status = 0;
+			p->status = 0;
+			return 0;
+		}
+		if (byte >= 0xf0) {
+			/* system common cancels running status */
+			p->running_status = 0;
+			if (byte == 0xf7) {
+				p->status = 0;
+				return 0;
+			}
+		} else {
+			p->running_status = byte;
+		}
+		p->status = byte;
+		p->needed = len;
+		if (!len)
+			return complete(p, msg);
+		return 0;
+	}
+
+	/* data byte */
+	if (!p->pos) {
+		if (!p->status || !p->needed) {
+			if (!p->running_status)
+				return 0;	/* stray data byte */
+			p->status = p->running_status;
+			p->needed = midi_data_length(p->status);
+		}
+	}
+	p->data[p->pos++] = byte;
+	if (p->pos < p->needed)
+		return 0;
+	complete(p, msg);
+	if (p->status >= 0xf0)
+		p->status = 0;	/* no running status for system common */
+	return 1;
+}
@@ -0,0 +1,63 @@
+/*
+ * midi-parser.h - incremental MIDI 1.0 byte stream parser
+ *
+ * Copyright (C) 2009 - 2026 Jakob Flierl <jakob.flierl@gmail.com>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+#ifndef MIDI_PARSER_H
+#define MIDI_PARSER_H
+
+#include <stddef.h>
+
+/* a complete message as seen on the wire */
+struct midi_message {
+	unsigned char status;
+	unsigned char data[2];
+	size_t length;		/* bytes incl. status (F0 and F7 for SysEx) */
+};
+
+/*
+ * The parser is fed one byte at a time and keeps its state between
+ * calls, so replies may be split across any number of reads.  Running
+ * status is expanded, realtime bytes (F8..FF) are reported as soon as
+ * they arrive without disturbing a message in progress, and SysEx
+ * payloads are copied to an optional caller supplied buffer.
+ */
+struct midi_parser {
+	unsigned char running_status;
+	unsigned char status;
+	unsigned char data[2];
+	unsigned int pos;
+	unsigned int needed;
+	int in_sysex;
+	unsigned char *sysex_buf;
+	size_t sysex_size;
+	size_t sysex_len;
+};
+
+void midi_parser_init(struct midi_parser *p,
+		      unsigned char *sysex_buf, size_t sysex_size);
+void midi_parser_reset(struct midi_parser *p);
+
+/* returns 1 and fills in *msg when byte completes a message */
+int midi_parser_feed(struct midi_parser *p, unsigned char byte,
+		     struct midi_message *msg);
+
+/* number of data bytes following status, or -1 for SysEx */
+int midi_data_length(unsigned char status);
+
+#endif /* MIDI_PARSER_H */
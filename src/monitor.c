@@ -0,0 +1,242 @@
+/*
+ * monitor.c - latency metrics of a long-running probe
+ *
+ * Copyright (C) 2009 - 2026 Jakob Flierl <jakob.flierl@gmail.com>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "monitor.h"
+
+/* upper bounds of the histogram buckets, in ns */
+static const unsigned int bucket_le[] = {
+	50000, 100000, 200000, 500000,
+	1000000, 2000000, 5000000,
+	10000000, 20000000, 50000000,
+	100000000, 200000000, 500000000,
+	1000000000,
+};
+#define NR_BUCKETS (sizeof(bucket_le) / sizeof(*bucket_le))
+
+struct monitor {
+	unsigned long long buckets[NR_BUCKETS + 1];	/* last one is +Inf */
+	unsigned long long count;
+	unsigned long long lost;
+	double sum;			/* s */
+	unsigned int max;		/* ns, since start */
+	unsigned int *window;
+	unsigned int *sorted;
+	unsigned int window_size;
+	unsigned int window_len;
+	unsigned int window_pos;
+};
+
+struct monitor *monitor_new(unsigned int window)
+{
+	struct monitor *m = calloc(1, sizeof(*m));
+
+	if (!m)
+		return NULL;
+	m->window_size = window;
+	m->window = calloc(window, sizeof(*m->window));
+	m->sorted = calloc(window, sizeof(*m->sorted));
+	if (!m->window || !m->sorted) {
+		monitor_free(m);
+		return NULL;
+	}
+	return m;
+}
+
+void monitor_free(struct monitor *m)
+{
+	if (!m)
+		return;
+	free(m->window);
+	free(m->sorted);
+	free(m);
+}
+
+void monitor_add(struct monitor *m, unsigned int delay_ns)
+{
+	unsigned int i;
+
+	for (i = 0; i < NR_BUCKETS && delay_ns > bucket_le[i]; ++i)
+		;
+	m->buckets[i]++;
+	m->count++;
+	m->sum += delay_ns / 1000000000.0;
+	if (delay_ns > m->max)
+		m->max = delay_ns;
+	m->window[m->window_pos] = delay_ns;
+	m->window_pos = (m->window_pos + 1) % m->window_size;
+	if (m->window_len < m->window_size)
+		m->window_len++;
+}
+
+void monitor_lost(struct monitor *m)
+{
+	m->lost++;
+}
+
+static int compare_uint(const void *p1, const void *p2)
+{
+	unsigned int a = *(const unsigned int *)p1;
+	unsigned int b = *(const unsigned int *)p2;
+
+	return a < b ? -1 : a > b;
+}
+
+void monitor_write(struct monitor *m, FILE *out)
+{
+	static const double quantiles[] = { 0.5, 0.9, 0.99, 1 };
+	unsigned long long cumulative = 0;
+	unsigned int i, rank;
+
+	fprintf(out, "# HELP alsa_midi_latency_seconds MIDI roundtrip latency.\n");
+	fprintf(out, "# TYPE alsa_midi_latency_seconds histogram\n");
+	for (i = 0; i < NR_BUCKETS; ++i) {
+		cumulative += m->buckets[i];
+		fprintf(out, "alsa_midi_latency_seconds_bucket{le=\"%g\"} %llu\n",
+			bucket_le[i] / 1000000000.0, cumulative);
+	}
+	fprintf(out, "alsa_midi_latency_seconds_bucket{le=\"+Inf\"} %llu\n", m->count);
+	fprintf(out, "alsa_midi_latency_seconds_sum %.9f\n", m->sum);
+	fprintf(out, "alsa_midi_latency_seconds_count %llu\n", m->count);
+
+	fprintf(out, "# HELP alsa_midi_lost_probes_total Probes that did not come back in time.\n");
+	fprintf(out, "# TYPE alsa_midi_lost_probes_total counter\n");
+	fprintf(out, "alsa_midi_lost_probes_total %llu\n", m->lost);
+
+	fprintf(out, "# HELP alsa_midi_latency_max_seconds Worst latency since start.\n");
+	fprintf(out, "# TYPE alsa_midi_latency_max_seconds gauge\n");
+	fprintf(out, "alsa_midi_latency_max_seconds %.9f\n", m->max / 1000000000.0);
+
+	if (!m->window_len)
+		return;
+	memcpy(m->sorted, m->window, m->window_len * sizeof(*m->sorted));
+	qsort(m->sorted, m->window_len, sizeof(*m->sorted), compare_uint);
+	fprintf(out, "# HELP alsa_midi_recent_latency_seconds Latency of the last %u probes.\n",
+		m->window_len);
+	fprintf(out, "# TYPE alsa_midi_recent_latency_seconds summary\n");
+	for (i = 0; i < sizeof(quantiles) / sizeof(*quantiles); ++i) {
+		rank = quantiles[i] * m->window_len + 0.5;
+		if (rank < 1)
+			rank = 1;
+		if (rank > m->window_len)
+			rank = m->window_len;
+		fprintf(out, "alsa_midi_recent_latency_seconds{quantile=\"%g\"} %.9f\n",
+			quantiles[i], m->sorted[rank - 1] / 1000000000.0);
+	}
+}
+
+int monitor_write_textfile(struct monitor *m, const char *path)
+{
+	char tmp[4096];
+	FILE *f;
+
+	/* the collector must never see a half-written file */
+	snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+	f = fopen(tmp, "w");
+	if (!f)
+		return -1;
+	monitor_write(m, f);
+	if (fclose(f) || rename(tmp, path)) {
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+/* 1 if nobody accepts connections on the socket at addr any more */
+static int socket_is_stale(const struct sockaddr_un *addr)
+{
+	int fd, stale;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return 0;
+	stale = connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0 &&
+		errno == ECONNREFUSED;
+	close(fd);
+	return stale;
+}
+
+int monitor_listen(const char *path)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	int fd, err;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	/* a stale socket of an earlier run, but never a live one or a file */
+	if (!lstat(path, &st) && S_ISSOCK(st.st_mode)) {
+		if (!socket_is_stale(&addr)) {
+			close(fd);
+			errno = EADDRINUSE;
+			return -1;
+		}
+		unlink(path);
+	}
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(fd, 4) < 0) {
+		err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+	return fd;
+}
+
+/* answers every pending client; never blocks the probe for long */
+void monitor_serve(struct monitor *m, int listen_fd)
+{
+	char *text;
+	size_t len;
+	FILE *f;
+	int fd;
+
+	while ((fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+		f = open_memstream(&text, &len);
+		if (f) {
+			monitor_write(m, f);
+			fclose(f);
+			if (send(fd, text, len, MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+				/* the client went away; its loss */
+			}
+			free(text);
+		}
+		close(fd);
+	}
+}
@@ -0,0 +1,47 @@
+/*
+ * monitor.h - latency metrics of a long-running probe
+ *
+ * Copyright (C) 2009 - 2026 Jakob Flierl <jakob.flierl@gmail.com>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include <stdio.h>
+
+struct monitor;
+
+/*
+ * keeps a cumulative histogram over log-scale buckets, for Prometheus,
+ * and the last window samples, for percentiles of the recent past
+ */
+struct monitor *monitor_new(unsigned int window);
+void monitor_free(struct monitor *m);
+
+void monitor_add(struct monitor *m, unsigned int delay_ns);
+void monitor_lost(struct monitor *m);
+
+/* the Prometheus text exposition format */
+void monitor_write(struct monitor *m, FILE *out);
+/* replaces path atomically, for node_exporter's textfile collector */
+int monitor_write_textfile(struct monitor *m, const char *path);
+
+/* a Unix domain socket that serves monitor_write() to each client */
+int monitor_listen(const char *path);
+void monitor_serve(struct monitor *m, int listen_fd);
+
+#endif /* MONITOR_H */
@@ -0,0 +1,145 @@
+/*
+ * trace.c - ftrace markers and Chrome trace-event export of samples
+ *
+ * Copyright (C) 2009 - 2026 Jakob Flierl <jakob.flierl@gmail.com>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+struct trace_json {
+	FILE *f;
+	int pid;
+	int tid;
+};
+
+/* closed at exit, so that fatal() leaves a complete file too */
+static struct trace_json *open_json;
+
+unsigned long long trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int trace_marker_open(void)
+{
+	static const char *const paths[] = {
+		"/sys/kernel/tracing/trace_marker",
+		"/sys/kernel/debug/tracing/trace_marker",
+	};
+	unsigned int i;
+	int fd;
+
+	for (i = 0; i < sizeof(paths) / sizeof(*paths); ++i) {
+		fd = open(paths[i], O_WRONLY | O_CLOEXEC);
+		if (fd >= 0)
+			return fd;
+	}
+	return -1;
+}
+
+void trace_mark(int fd, const char *fmt, ...)
+{
+	char buf[128];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if (len > (int)sizeof(buf) - 1)
+		len = sizeof(buf) - 1;
+	/* tracing off or buffer full; nothing to do about it */
+	(void)!write(fd, buf, len);
+}
+
+static void trace_json_close_at_exit(void)
+{
+	trace_json_close(open_json);
+}
+
+/*
+ * the JSON Array Format, one event per line: viewers accept it without
+ * the closing bracket, should the process die before writing that
+ */
+struct trace_json *trace_json_open(const char *path)
+{
+	static int registered;
+	struct trace_json *t = calloc(1, sizeof(*t));
+
+	if (!t)
+		return NULL;
+	t->f = fopen(path, "w");
+	if (!t->f) {
+		free(t);
+		return NULL;
+	}
+	t->pid = getpid();
+	t->tid = syscall(SYS_gettid);
+	fprintf(t->f, "[\n");
+	fprintf(t->f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+		"\"args\":{\"name\":\"alsa-midi-latency-test\"}}", t->pid, t->tid);
+	open_json = t;
+	if (!registered && !atexit(trace_json_close_at_exit))
+		registered = 1;
+	return t;
+}
+
+/* a complete ("X") event; trace-event timestamps are in microseconds */
+static void span(struct trace_json *t, const char *name,
+		 unsigned long long from, unsigned long long to,
+		 unsigned int sample_nr)
+{
+	if (!from || to < from)
+		return;
+	fprintf(t->f, ",\n{\"name\":\"%s\",\"cat\":\"midi\",\"ph\":\"X\","
+		"\"ts\":%llu.%03llu,\"dur\":%llu.%03llu,\"pid\":%d,\"tid\":%d,"
+		"\"args\":{\"sample\":%u}}",
+		name, from / 1000, from % 1000, (to - from) / 1000,
+		(to - from) % 1000, t->pid, t->tid, sample_nr);
+}
+
+void trace_json_sample(struct trace_json *t, unsigned int sample_nr,
+		       const struct probe_times *times)
+{
+	span(t, "roundtrip", times->begin, times->end, sample_nr);
+	span(t, "send", times->begin, times->sent, sample_nr);
+	span(t, "in flight", times->sent, times->wake, sample_nr);
+	span(t, "receive", times->wake, times->end, sample_nr);
+}
+
+void trace_json_close(struct trace_json *t)
+{
+	if (!t)
+		return;
+	if (t == open_json)
+		open_json = NULL;
+	fprintf(t->f, "\n]\n");
+	fclose(t->f);
+	free(t);
+}
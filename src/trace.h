@@ -0,0 +1,49 @@
+/*
+ * trace.h - ftrace markers and Chrome trace-event export of samples
+ *
+ * Copyright (C) 2009 - 2026 Jakob Flierl <jakob.flierl@gmail.com>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * phase boundaries of one sample, in CLOCK_MONOTONIC nanoseconds, which
+ * is what ftrace uses with trace_clock set to "mono"
+ */
+struct probe_times {
+	unsigned long long begin;	/* about to write the probe */
+	unsigned long long sent;	/* write returned */
+	unsigned long long wake;	/* poll() returned with the final bytes */
+	unsigned long long end;		/* the probe was parsed completely */
+};
+
+unsigned long long trace_now(void);
+
+/* returns a descriptor for tracefs' trace_marker, or -1 */
+int trace_marker_open(void);
+void trace_mark(int fd, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+struct trace_json;
+
+struct trace_json *trace_json_open(const char *path);
+void trace_json_sample(struct trace_json *t, unsigned int sample_nr,
+		       const struct probe_times *times);
+void trace_json_close(struct trace_json *t);
+
+#endif /* TRACE_H */
@@ -0,0 +1,137 @@
+/*
+ * ump.c - MIDI 2.0 Universal MIDI Packets
+ *
+ * Copyright (C) 2009 - 2026 Jakob Flierl <jakob.flierl@gmail.com>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+#include <string.h>
+
+#include "ump.h"
+
+int ump_packet_words(unsigned int word0)
+{
+	switch (word0 >> 28) {
+	case 0x0:
+	case 0x1:
+	case 0x2:
+	case 0x6:
+	case 0x7:
+		return 1;
+	case 0x3:
+	case 0x4:
+	case 0x8:
+	case 0x9:
+	case 0xa:
+		return 2;
+	case 0xb:
+	case 0xc:
+		return 3;
+	default:
+		return 4;
+	}
+}
+
+/* min-center-max scaling, as in the MIDI 2.0 protocol specification */
+static unsigned int scale_up(unsigned int value, int src_bits, int dst_bits)
+{
+	int scale_bits = dst_bits - src_bits, repeat_bits = src_bits - 1;
+	unsigned int result = value << scale_bits;
+	unsigned int repeat;
+
+	if (value <= 1U << (src_bits - 1))
+		return result;
+	repeat = value & ((1U << repeat_bits) - 1);
+	if (scale_bits > repeat_bits)
+		repeat <<= scale_bits - repeat_bits;
+	else
+		repeat >>= repeat_bits - scale_bits;
+	while (repeat) {
+		result |= repeat;
+		repeat >>= repeat_bits;
+	}
+	return result;
+}
+
+int ump_from_midi1(int bits, const unsigned char *msg, size_t len,
+		   unsigned int *words)
+{
+	unsigned int status = msg[0];
+	unsigned int d0 = len > 1 ? msg[1] : 0;
+	unsigned int d1 = len > 2 ? msg[2] : 0;
+
+	memset(words, 0, 4 * sizeof(*words));
+	if (status >= 0xf0) {
+		words[0] = 0x10000000 | status << 16 | d0 << 8 | d1;
+		return 1;
+	}
+	switch (bits) {
+	case 32:
+		words[0] = 0x20000000 | status << 16 | d0 << 8 | d1;
+		return 1;
+	case 64:
+		words[0] = 0x40000000 | status << 16;
+		switch (status & 0xf0) {
+		case 0x80:
+		case 0x90:
+			words[0] |= d0 << 8;
+			words[1] = scale_up(d1, 7, 16) << 16;
+			break;
+		case 0xa0:
+		case 0xb0:
+			words[0] |= d0 << 8;
+			words[1] = scale_up(d1, 7, 32);
+			break;
+		case 0xc0:
+			words[1] = d0 << 24;
+			break;
+		case 0xd0:
+			words[1] = scale_up(d0, 7, 32);
+			break;
+		case 0xe0:
+			words[1] = scale_up(d0 | d1 << 7, 14, 32);
+			break;
+		}
+		return 2;
+	default:
+		/* SysEx8 in one packet: stream ID 0, then the message bytes */
+		words[0] = 0x50000000 | (unsigned int)(len + 1) << 16 | status;
+		words[1] = d0 << 24 | d1 << 16;
+		return 4;
+	}
+}
+
+unsigned int ump_jr_timestamp(unsigned int ticks)
+{
+	return 0x00200000 | (ticks & 0xffff);
+}
+
+void ump_parser_reset(struct ump_parser *p)
+{
+	p->pos = 0;
+	p->needed = 0;
+}
+
+int ump_parser_feed(struct ump_parser *p, unsigned int word)
+{
+	if (!p->pos)
+		p->needed = ump_packet_words(word);
+	p->words[p->pos++] = word;
+	if (p->pos < p->needed)
+		return 0;
+	p->pos = 0;
+	return p->needed;
+}
@@ -0,0 +1,53 @@
+/*
+ * ump.h - MIDI 2.0 Universal MIDI Packets
+ *
+ * Copyright (C) 2009 - 2026 Jakob Flierl <jakob.flierl@gmail.com>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+#ifndef UMP_H
+#define UMP_H
+
+#include <stddef.h>
+
+/* number of 32-bit words in a packet, from its message type */
+int ump_packet_words(unsigned int word0);
+
+/*
+ * translates a MIDI 1.0 message into a packet of the given size, in
+ * group 0: 32 bits is the MIDI 1.0 channel voice message (MT 2), 64 bits
+ * the MIDI 2.0 channel voice message (MT 4), and 128 bits a SysEx8
+ * packet (MT 5) carrying the message bytes.  System messages always use
+ * the 32-bit system message (MT 1).  Returns the number of words.
+ */
+int ump_from_midi1(int bits, const unsigned char *msg, size_t len,
+		   unsigned int *words);
+
+/* a JR Timestamp utility message, in ticks of 1/31250 s */
+unsigned int ump_jr_timestamp(unsigned int ticks);
+
+/* collects whole packets from a word stream, see midi_parser */
+struct ump_parser {
+	unsigned int words[4];
+	int pos;
+	int needed;
+};
+
+void ump_parser_reset(struct ump_parser *p);
+/* returns the number of words once word completes a packet in p->words */
+int ump_parser_feed(struct ump_parser *p, unsigned int word);
+
+#endif /* UMP_H */